@@ -49,10 +49,17 @@ if test "$PHP_WM" != "no"; then
         fi
     fi
 
+    dnl io_uring后端需要内核的头文件，没有的话只编译epoll后端
+    AC_CHECK_HEADERS([linux/io_uring.h])
+
     dnl 把我们需要编译的所有文件已字符串的方式存入到变量workerman_source_file里面。
     workerman_source_file="\
     	src/core/base.c \
+    	src/core/poll.c \
+    	src/core/poll_io_uring.c \
+    	src/core/poll_poll.c \
     	src/core/log.c \
+    	src/core/histogram.c \
     	src/core/socket.c \
     	src/core/timer.c \
     	src/core/wm_string.c \
@@ -62,6 +69,7 @@ if test "$PHP_WM" != "no"; then
     	src/coroutine/context.c \
     	src/coroutine/coroutine.c \
     	src/coroutine/socket.c \
+    	src/coroutine/sync.c \
     	src/worker/loop.c \
     	src/worker/signal.c \
     	src/worker/connection.c \
@@ -70,6 +78,7 @@ if test "$PHP_WM" != "no"; then
     	php_coroutine.c \
         php_workerman.c \
         php_channel.c \
+        php_sync.c \
         php_worker.c \
         php_connection.c \
         php_runtime.c \
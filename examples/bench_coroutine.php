@@ -0,0 +1,32 @@
+<?php
+use Warriorman\Coroutine;
+
+/**
+ * 协程创建+退出的开销
+ * php bench_coroutine.php        开着缓存池
+ * php bench_coroutine.php nopool 关掉缓存池，对比用
+ */
+$n = 200000;
+
+if (($argv[1] ?? '') === 'nopool') {
+    Coroutine::set([
+        'stack_pool_max' => 0,
+        'task_pool_max' => 0
+    ]);
+}
+
+// 先跑一轮预热，把池子填上
+for ($i = 0; $i < 1000; $i ++) {
+    Coroutine::create(function () {});
+}
+
+$start = hrtime(true);
+for ($i = 0; $i < $n; $i ++) {
+    Coroutine::create(function () {});
+}
+$cost = hrtime(true) - $start;
+
+printf("%d coroutines, %.2f ms, %.1f ns/coroutine\n", $n, $cost / 1e6, $cost / $n);
+print_r(Coroutine::getPoolStats());
+
+Coroutine::wait();
@@ -0,0 +1,31 @@
+<?php
+/**
+ * 取消协程和截止时间
+ */
+use Warriorman\Coroutine;
+
+$cid = work(function () {
+	//卡在sleep里面，被取消的话提前醒来返回false
+	var_dump(Coroutine::sleep(10));
+	var_dump(Coroutine::isCancelled());
+});
+
+work(function () use ($cid) {
+	Coroutine::sleep(0.1);
+	var_dump(Coroutine::cancel($cid));
+});
+
+work(function () {
+	//0.2秒之后取消，子协程也跟着一起
+	Coroutine::setDeadline(0.2);
+	work(function () {
+		$chan = new Warriorman\Channel(1);
+		var_dump($chan->pop());
+		var_dump(Coroutine::stats()['cancelled']);
+	});
+	var_dump(Coroutine::sleep(1));
+});
+
+if (! defined("RUN_TEST")) {
+	worker_event_wait();
+}
@@ -0,0 +1,25 @@
+<?php
+/**
+ * 协程本地存储
+ */
+use Warriorman\Coroutine;
+
+Coroutine::set(['inherit_context' => true]);
+
+work(function () {
+	$ctx = Coroutine::getContext();
+	$ctx['request_id'] = uniqid();
+	work(function () {
+		//子协程和父协程是同一个context
+		var_dump(Coroutine::getContext()['request_id']);
+	});
+	Coroutine::createWithOptions(['inherit_context' => false], function () {
+		var_dump(isset(Coroutine::getContext()['request_id']));
+	});
+});
+
+var_dump(Coroutine::getContext());
+
+if (! defined("RUN_TEST")) {
+	worker_event_wait();
+}
@@ -0,0 +1,32 @@
+<?php
+/**
+ * 并发跑一组任务，最多同时跑2个，key保持不变
+ */
+use Warriorman\Coroutine;
+
+work(function () {
+	$results = Coroutine::parallel([
+		'a' => function () {
+			Coroutine::sleep(0.1);
+			return 'a';
+		},
+		'b' => function () {
+			throw new Exception('b failed');
+		},
+		'c' => function () {
+			Coroutine::sleep(0.2);
+			return 'c';
+		},
+		'slow' => function () {
+			Coroutine::sleep(5);
+			return 'slow';
+		}
+	], 2, 1);
+	//slow超时了，不在结果里面
+	var_dump(array_keys($results));
+	var_dump($results['b'] instanceof Exception);
+});
+
+if (! defined("RUN_TEST")) {
+	worker_event_wait();
+}
@@ -0,0 +1,35 @@
+<?php
+/**
+ * 协程优先级：同一时刻被唤醒的协程，高优先级的先恢复
+ * 预期输出 high high normal normal low low
+ */
+use Warriorman\Coroutine;
+use Warriorman\Lib\Timer;
+
+$wg = new Warriorman\WaitGroup();
+$wg->add();
+
+//按低、普通、高的顺序排队等
+foreach ([Coroutine::PRIORITY_LOW, Coroutine::PRIORITY_NORMAL, Coroutine::PRIORITY_HIGH] as $priority) {
+	for ($i = 0; $i < 2; $i++) {
+		Coroutine::createWithOptions(['priority' => $priority], function () use ($wg) {
+			$wg->wait();
+			$stats = Coroutine::stats();
+			var_dump($stats['priority']);
+		});
+	}
+}
+
+work(function () use ($wg) {
+	Coroutine::sleep(0.1);
+	$wg->done();
+});
+
+//心跳定时器，回调协程是高优先级
+Timer::addWithOptions(0.5, function () {
+	var_dump('heartbeat ' . Coroutine::getPriority());
+}, ['persistent' => false, 'priority' => Coroutine::PRIORITY_HIGH]);
+
+if (! defined("RUN_TEST")) {
+	worker_event_wait();
+}
@@ -0,0 +1,30 @@
+<?php
+/**
+ * 栈剖析，看看协程实际用了多少栈
+ */
+use Warriorman\Coroutine;
+
+Coroutine::set(['stack_profile' => true]);
+
+function deep($n) {
+	return $n > 0 ? deep($n - 1) + 1 : 0;
+}
+
+for ($i = 0; $i < 100; $i++) {
+	work(function () use ($i) {
+		Coroutine::sleep(0.01);
+		deep($i * 10);
+	});
+}
+work(function () {
+	usleep(1);
+});
+
+work(function () {
+	Coroutine::sleep(0.1);
+	print_r(Coroutine::getStackProfile(true));
+});
+
+if (! defined("RUN_TEST")) {
+	worker_event_wait();
+}
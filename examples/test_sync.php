@@ -0,0 +1,35 @@
+<?php
+/**
+ * 同步原语：WaitGroup、Mutex、Semaphore、Barrier
+ */
+$wg = new Warriorman\WaitGroup();
+$mutex = new Warriorman\Mutex();
+$sem = new Warriorman\Semaphore(2);
+$barrier = new Warriorman\Barrier(3);
+
+for ($i = 0; $i < 3; $i++) {
+	$wg->add();
+	Warriorman::create(function () use ($i, $wg, $mutex, $sem, $barrier) {
+		//最多两个协程同时进来
+		$sem->acquire();
+		Warriorman\Coroutine::sleep(0.1);
+		$sem->release();
+
+		$mutex->lock();
+		var_dump("locked by $i");
+		$mutex->unlock();
+
+		$barrier->wait();
+		var_dump("barrier passed $i");
+		$wg->done();
+	});
+}
+
+Warriorman::create(function () use ($wg) {
+	var_dump($wg->wait(1));
+	var_dump("all done");
+});
+
+if (! defined("RUN_TEST")) {
+	worker_event_wait();
+}
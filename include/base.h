@@ -14,6 +14,7 @@
 #include "file.h"
 #include "array.h"
 #include "hash.h"
+#include "wm_poll.h"
 
 //构造函数用到
 typedef struct {
@@ -171,6 +172,17 @@ extern zend_class_entry *workerman_coroutine_ce_ptr;
  */
 extern zend_class_entry workerman_channel_ce;
 extern zend_class_entry *workerman_channel_ce_ptr;
+/**
+ * WaitGroup、Mutex、Semaphore、Barrier类
+ */
+extern zend_class_entry workerman_waitgroup_ce;
+extern zend_class_entry *workerman_waitgroup_ce_ptr;
+extern zend_class_entry workerman_mutex_ce;
+extern zend_class_entry *workerman_mutex_ce_ptr;
+extern zend_class_entry workerman_semaphore_ce;
+extern zend_class_entry *workerman_semaphore_ce_ptr;
+extern zend_class_entry workerman_barrier_ce;
+extern zend_class_entry *workerman_barrier_ce_ptr;
 /**
  * Runtime类
  */
@@ -264,6 +276,8 @@ void workerman_connection_init();
 void workerman_worker_init();
 //channel注册方法
 void workerman_channel_init();
+//同步原语注册方法
+void workerman_sync_init();
 //runtime注册方法
 void workerman_runtime_init();
 //定时器注册方法
@@ -273,16 +287,12 @@ void php_wmTimer_init();
 void php_wmTimer_shutdown();
 
 //定义的一些结构体
-typedef struct {
-	int epollfd; //创建的epollfd。
-	int ncap; //epoll回调可以接收最多事件数量
-	int event_num; // 当前在监听的事件的数量
-	struct epoll_event *events; //是用来保存epoll返回的事件。
-	struct epoll_event *event; //用来储存每一次添加修改epoll的临时变量
-} wmPoll_t;
-
 typedef struct {
 	bool is_running; //epoll是否正常营业
+	int poll_type; //reactor后端类型，在创建poll之前设置
+	int max_events; //事件数组最多能扩到多大
+	int busy_poll; //loop阻塞等待之前先空转多少微秒，0是不空转
+	uint64_t now; //缓存的单调时钟，微秒，loop每轮等完事件之后更新
 	wmPoll_t *poll;
 	wmTimerWheel timer; //核心定时器
 	wmString *buffer_stack; //用于整个项目的临时字符串存储
@@ -299,4 +309,24 @@ int wm_event_wait();
 //定义的全局变量，在base.cc中
 extern wmGlobal_t WorkerG;
 
+/**
+ * 重新读一次单调时钟，更新WorkerG.now，返回毫秒
+ * 时间轮用的也是这个毫秒数，不受系统改时间的影响
+ */
+static inline uint64_t wm_update_now() {
+	WorkerG.now = wmGetMonotonicMicroTime();
+	return WorkerG.now / 1000;
+}
+
+/**
+ * 缓存的单调时钟，微秒
+ * loop跑着的时候直接用这一轮的时间，没跑的时候没人更新，现读一次
+ */
+static inline uint64_t wm_get_now() {
+	if (!WorkerG.is_running) {
+		wm_update_now();
+	}
+	return WorkerG.now;
+}
+
 #endif	/* _WM_BASH_H */
@@ -13,6 +13,7 @@ typedef struct {
 	wmQueue *consumer_queue;
 	//这个里面存着，存入channle中的数据
 	wmQueue *data_queue;
+	bool closed; //要释放了，等待的协程醒来就别再等了
 } wmChannel;
 
 wmChannel* wmChannel_create(uint32_t _capacity);
@@ -4,6 +4,9 @@
 #include "base.h"
 #include "asm_context.h"
 
+//栈剖析的时候刷在栈上的图案，没被改过的地方就是没用到的
+#define WM_STACK_CANARY 0x5aa5c33cdeadbeefULL
+
 typedef fcontext_t coroutine_context_t;
 typedef void (*coroutine_func_t)(void*);
 
@@ -14,16 +17,37 @@ typedef struct {
 	coroutine_func_t fn_;
 	uint32_t stack_size_;
 	void *private_data_;
-	char* stack_;
+	char* stack_; //栈底，下面紧挨着一个保护页
+	bool hugetlb_; //是不是大页
+	bool profiled_; //开了栈剖析，init的时候栈刷过canary
+	uint32_t stack_used_; //destroy的时候量出来的C栈用量，只有profiled_的时候有
 	//指向汇编
 	coroutine_context_t ctx_;
 	coroutine_context_t swap_ctx_;
 	bool end_;
 } wmContext;
 
-void wmContext_init(wmContext *ctx, size_t stack_size, coroutine_func_t fn, void* private_data);
+/**
+ * C栈缓存池的统计
+ */
+typedef struct {
+	uint32_t num; //池子里现在有几个
+	uint32_t max; //最多缓存几个，超过了直接释放
+	uint32_t peak; //池子里最多的时候有几个
+	uint64_t hits; //创建协程的时候从池子里拿到了
+	uint64_t misses; //池子空了，重新申请的
+	uint64_t frees; //池子满了，直接释放的
+} wmContext_pool_stats;
+
+size_t wmContext_stack_size(size_t stack_size, bool hugetlb);
+bool wmContext_init(wmContext *ctx, size_t stack_size, bool hugetlb, coroutine_func_t fn, void* private_data);
 bool wmContext_swap_out(wmContext *ctx);
 bool wmContext_swap_in(wmContext *ctx);
 void wmContext_destroy(wmContext *ctx);
+void wmContext_pool_set_max(uint32_t max);
+wmContext_pool_stats* wmContext_pool_get_stats();
+void wmContext_pool_clear();
+void wmContext_set_profile(bool enable);
+bool wmContext_get_profile();
 
 #endif	/* WM_CONTEXT_H */
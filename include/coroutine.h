@@ -4,6 +4,31 @@
 #include "base.h"
 #include "context.h"
 
+/**
+ * 协程yield的时候在等什么，listAll和coroutines命令里面看
+ */
+enum wmCoroutine_wait_type {
+	WM_WAIT_NONE = 0, //直接调用的yield
+	WM_WAIT_READ = 1, //socket可读
+	WM_WAIT_WRITE = 2, //socket可写
+	WM_WAIT_CHANNEL = 3, //channel
+	WM_WAIT_SLEEP = 4, //sleep
+	WM_WAIT_SYNC = 5, //WaitGroup、Mutex、Semaphore、Barrier
+	WM_WAIT_PAUSED = 6, //连接暂停接收
+	WM_WAIT_ACCEPT = 7, //worker过载，accept停着
+};
+
+/**
+ * 优先级，就绪队列按这个分开，数字小的先恢复
+ */
+enum wmCoroutine_priority {
+	WM_PRIORITY_HIGH = 0, //健康检查、心跳、控制消息
+	WM_PRIORITY_NORMAL = 1,
+	WM_PRIORITY_LOW = 2, //批量的活，边缘触发的socket事件来了也先进就绪队列排队
+};
+
+#define wmCoroutine_priority_valid(p) ((p) >= WM_PRIORITY_HIGH && (p) <= WM_PRIORITY_LOW)
+
 //协程参数结构体
 typedef struct {
 	zend_fcall_info_cache *fci_cache;
@@ -24,24 +49,109 @@ typedef struct _Coroutine {
 	//以下是coroutine结构
 	wmContext ctx;
 	long cid; //协程类ID
+	bool yielded; //yield了，在等resume
+	bool ready; //在就绪队列里面，等loop来resume
+	uint8_t priority; //wmCoroutine_priority，没指定就跟着创建它的协程
 	struct _Coroutine *origin; //唤起协程，记录哪个协程，创建的这个协程
 	wmStack *defer_tasks; //所有的defer
 
 	coroutine_func_t _defer; //c语言级别defer
 	void *_defer_data; //c语言级别defer
+
+	//在WaitGroup、Mutex这些同步原语上等的时候用，一个协程同时只会等一个东西
+	wmListNode wait_node; //挂在原语的等待链表上，摘下来之后指向自己
+	wmTimerWheel_Node *wait_timer; //等待超时的定时器
+	bool wait_timeout; //是超时醒来的，没等到
+
+	//取消
+	int cancelled; //被取消了，值是错误码WM_ERROR_COROUTINE_CANCELED或者WM_ERROR_COROUTINE_DEADLINE
+	bool cancelable; //yield在可以取消的地方，取消的时候可以直接唤醒
+	uint64_t deadline; //截止时间，和WorkerG.now一样是单调时钟的微秒，0是没有
+	wmTimerWheel_Node *deadline_timer; //到了截止时间取消自己
+
+	//在等什么，resume的时候清掉
+	int wait_type; //wmCoroutine_wait_type
+	int wait_fd; //等的socket，没有是-1
+	uint64_t yield_at; //最近一次yield的时间，和WorkerG.now一样是单调时钟的微秒
+
+	zval *result; //不为NULL的时候，入口函数的返回值和没接住的异常放到这里，见wmCoroutine_create_with_result
+	zval context; //协程本地存储，Coroutine::getContext()第一次用的时候才创建ArrayObject，没有的时候是IS_UNDEF
+
+	//统计，切换的时候记
+	zend_function *func; //入口函数
+	uint64_t created; //创建时间，和WorkerG.now一样是单调时钟的微秒
+	uint64_t cpu_time; //一共跑了多少纳秒，不算它唤起的协程
+	uint64_t last_run; //最近一次切进来的时间，纳秒
+	uint32_t switches; //切进来多少次
 } wmCoroutine;
 
+/**
+ * wmCoroutine结构体和PHP栈第一页回收池的统计
+ */
+typedef struct {
+	uint32_t task_num; //池子里有几个wmCoroutine
+	uint32_t page_num; //池子里有几个PHP栈页
+	uint64_t task_hits;
+	uint64_t task_misses;
+	uint64_t page_hits;
+	uint64_t page_misses;
+} wmCoroutine_pool_stats;
+
+/**
+ * 栈剖析，按入口函数汇总，单位都是字节
+ * PHP栈只量第一页，扩出来的页在函数返回的时候PHP自己就释放了，只能记下扩过几次
+ */
+typedef struct {
+	char name[128]; //入口函数，和wmCoroutine_get_name一样
+	wmHistogram c_stack; //C栈用到多深
+	wmHistogram php_stack; //PHP栈第一页用了多少
+	uint64_t php_overflows; //第一页不够用，扩了页
+	size_t c_stack_size; //最近一次分到的C栈大小
+} wmCoroutine_stack_profile;
+
 long wmCoroutine_create(zend_fcall_info_cache *fci_cache, uint32_t argc, zval *argv);
+long wmCoroutine_create_ex(zend_fcall_info_cache *fci_cache, uint32_t argc, zval *argv, size_t stack_size, bool hugetlb);
+long wmCoroutine_create_with_result(zend_fcall_info_cache *fci_cache, uint32_t argc, zval *argv, zval *result);
+void wmCoroutine_set_stack_size(size_t stack_size);
+size_t wmCoroutine_get_stack_size();
 wmCoroutine* wmCoroutine_get_by_cid(long _cid);
 void wmCoroutine_yield();
+bool wmCoroutine_yield_cancelable();
+bool wmCoroutine_cancel(wmCoroutine *task, int code);
+bool wmCoroutine_set_deadline(wmCoroutine *task, uint64_t deadline);
 bool wmCoroutine_resume(wmCoroutine *task);
-void vm_stack_destroy();
+void wmCoroutine_ready(wmCoroutine *task);
+bool wmCoroutine_has_ready();
+bool wmCoroutine_run_ready();
+void wmCoroutine_set_ready_budget(uint32_t budget);
+void wmCoroutine_set_priority(wmCoroutine *task, int priority);
+void wmCoroutine_set_next_priority(int priority);
+const char* wmCoroutine_get_priority_name(int priority);
+void wmCoroutine_set_direct_resume(bool direct);
+void wmCoroutine_set_inherit_context(bool inherit);
+bool wmCoroutine_get_inherit_context();
+zval* wmCoroutine_get_context(wmCoroutine *task);
+void vm_stack_destroy(wmCoroutine *task);
 void wmCoroutine_defer(php_fci_fcc *defer_fci_fcc);
-void wmCoroutine_sleep(double seconds);
+bool wmCoroutine_sleep(double seconds);
 void wmCoroutine_set_callback(long cid, coroutine_func_t _defer, void *_defer_data);
 wmCoroutine* wmCoroutine_get_current();
 void wmCoroutine_init();
 void wmCoroutine_shutdown();
 int wmCoroutine_getTotalNum(); //获取一共有多少个协程
+wmCoroutine_pool_stats* wmCoroutine_get_pool_stats();
+uint64_t wmCoroutine_get_cpu_time(wmCoroutine *task);
+int wmCoroutine_top(wmCoroutine **list, int n);
+int wmCoroutine_get_name(wmCoroutine *task, char *buf, size_t size);
+void wmCoroutine_set_wait(int type, int fd);
+const char* wmCoroutine_get_state(wmCoroutine *task);
+const char* wmCoroutine_get_wait_name(wmCoroutine *task);
+int wmCoroutine_list(wmCoroutine **list, int n);
+zend_execute_data* wmCoroutine_get_execute_data(wmCoroutine *task);
+int wmCoroutine_get_frame(zend_execute_data *ex, char *buf, size_t size);
+void wmCoroutine_dump(wmString *out);
+void wmCoroutine_set_pool_max(uint32_t max);
+int wmCoroutine_get_stack_profiles(wmCoroutine_stack_profile ***list);
+void wmCoroutine_reset_stack_profiles();
 
 #endif	/* WM_COROUTINE_H */
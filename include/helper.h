@@ -73,6 +73,20 @@ static inline void wmGetMicroTime(long *microseconds) {
 	*microseconds = tv.tv_usec;
 }
 
+//单调时钟的微秒数，只用来算耗时
+static inline uint64_t wmGetMonotonicMicroTime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//单调时钟的纳秒数，协程记CPU时间用
+static inline uint64_t wmGetMonotonicNanoTime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 static inline uint64_t touint64(int fd, int id) {
 	uint64_t ret = 0;
 	ret |= ((uint64_t) fd) << 32;
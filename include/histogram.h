@@ -0,0 +1,52 @@
+#ifndef WM_HISTOGRAM_H
+#define WM_HISTOGRAM_H
+
+/**
+ * 直方图，用来统计loop的耗时之类的分布
+ * 和HDR Histogram一个思路：按2的幂分段，每段再平均分成4格，误差不超过25%
+ * 内存是固定的，记录只是几个加法，不需要加锁，每个进程只有一个线程在写
+ */
+#include "header.h"
+
+#define WM_HISTOGRAM_SUB_BITS 2 //每段分成2^2格
+#define WM_HISTOGRAM_SUB_COUNT (1 << WM_HISTOGRAM_SUB_BITS)
+#define WM_HISTOGRAM_BUCKETS ((64 - WM_HISTOGRAM_SUB_BITS + 1) * WM_HISTOGRAM_SUB_COUNT)
+
+typedef struct {
+	uint64_t count; //记录了多少次
+	uint64_t sum; //总和，用来算平均值
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[WM_HISTOGRAM_BUCKETS];
+} wmHistogram;
+
+//值对应的格子
+static inline int wmHistogram_index(uint64_t value) {
+	if (value < WM_HISTOGRAM_SUB_COUNT) {
+		return (int) value;
+	}
+	int msb = 63 - __builtin_clzll(value);
+	int shift = msb - WM_HISTOGRAM_SUB_BITS;
+	return (msb - WM_HISTOGRAM_SUB_BITS + 1) * WM_HISTOGRAM_SUB_COUNT + (int) ((value >> shift) & (WM_HISTOGRAM_SUB_COUNT - 1));
+}
+
+//记录一个值
+static inline void wmHistogram_record(wmHistogram *h, uint64_t value) {
+	h->buckets[wmHistogram_index(value)]++;
+	if (h->count == 0 || value < h->min) {
+		h->min = value;
+	}
+	if (value > h->max) {
+		h->max = value;
+	}
+	h->count++;
+	h->sum += value;
+}
+
+void wmHistogram_reset(wmHistogram *h);
+//百分位数，percentile是0到100，返回所在格子的上限
+uint64_t wmHistogram_percentile(wmHistogram *h, double percentile);
+//平均值
+double wmHistogram_mean(wmHistogram *h);
+
+#endif	/* WM_HISTOGRAM_H */
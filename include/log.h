@@ -28,6 +28,11 @@ enum wmCode {
 	WM_ERROR_READ_FAIL = 1006, //接收失败
 	WM_ERROR_LOOP_FAIL = 1007, //LOOP相关错误
 	WM_ERROR_PROTOCOL_FAIL = 1008, //错误的协议
+	/**
+	 * coroutine error
+	 */
+	WM_ERROR_COROUTINE_CANCELED = 1009, //协程被取消了
+	WM_ERROR_COROUTINE_DEADLINE = 1010, //协程到了截止时间
 };
 
 #define wmDebug(wmr, ...)                                                         \
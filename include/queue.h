@@ -54,6 +54,21 @@ static inline void * wmQueue_pop(wmQueue* queue) {
 	return ((wmQueueNode*) next)->data;
 }
 
+//删除第一个数据是data的元素，找到了返回true
+static inline bool wmQueue_remove(wmQueue* queue, void *data) {
+	wmListNode* head = (wmListNode *) &queue->head;
+	wmListNode* pos;
+	for (pos = head->next; pos != head; pos = pos->next) {
+		if (((wmQueueNode*) pos)->data == data) {
+			wmList_remote(pos);
+			wm_free(pos);
+			queue->num--;
+			return true;
+		}
+	}
+	return false;
+}
+
 //获取长度
 static inline int wmQueue_len(wmQueue* queue) {
 	return queue->num;
@@ -34,4 +34,9 @@ int wm_socket_close(int fd);
  */
 int wm_socket_reuse_port(int fd);
 
+/**
+ * 设置忙轮询，usec是微秒
+ */
+int wm_socket_busy_poll(int fd, int usec);
+
 #endif
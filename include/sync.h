@@ -0,0 +1,52 @@
+#ifndef _WM_SYNC_H
+#define _WM_SYNC_H
+/**
+ * 协程同步原语：WaitGroup、Mutex、Semaphore、Barrier
+ * 等待队列是侵入式的，直接把wmCoroutine里面的wait_node挂上去，不用另外申请内存
+ */
+#include "base.h"
+
+typedef struct {
+	int64_t count; //还有多少个没done
+	wmListNode waiters;
+} wmWaitGroup;
+
+typedef struct {
+	long owner; //持有锁的协程cid，0是没人持有
+	wmListNode waiters;
+} wmMutex;
+
+typedef struct {
+	int64_t permits; //还剩几个许可
+	wmListNode waiters;
+} wmSemaphore;
+
+typedef struct {
+	uint32_t parties; //凑齐多少个协程放行
+	uint32_t arrived; //这一轮已经到了几个
+	uint64_t generation; //第几轮
+	wmListNode waiters;
+} wmBarrier;
+
+void wmWaitGroup_init(wmWaitGroup *wg, int64_t count);
+bool wmWaitGroup_add(wmWaitGroup *wg, int64_t delta);
+bool wmWaitGroup_wait(wmWaitGroup *wg, double timeout);
+void wmWaitGroup_destroy(wmWaitGroup *wg);
+
+void wmMutex_init(wmMutex *mutex);
+bool wmMutex_lock(wmMutex *mutex, double timeout);
+bool wmMutex_trylock(wmMutex *mutex);
+bool wmMutex_unlock(wmMutex *mutex);
+void wmMutex_destroy(wmMutex *mutex);
+
+void wmSemaphore_init(wmSemaphore *sem, int64_t permits);
+bool wmSemaphore_acquire(wmSemaphore *sem, double timeout);
+bool wmSemaphore_tryacquire(wmSemaphore *sem);
+void wmSemaphore_release(wmSemaphore *sem);
+void wmSemaphore_destroy(wmSemaphore *sem);
+
+void wmBarrier_init(wmBarrier *barrier, uint32_t parties);
+bool wmBarrier_wait(wmBarrier *barrier, double timeout);
+void wmBarrier_destroy(wmBarrier *barrier);
+
+#endif
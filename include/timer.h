@@ -6,6 +6,7 @@
  */
 #include "header.h"
 #include "list.h"
+#include "histogram.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////
 // 时间轮定时器
@@ -58,6 +59,8 @@ typedef struct timerwheel {
 	uint16_t remainder;            // 剩余的毫秒
 	uint32_t num;				   // 当前剩余任务数
 	wmListNode so_long_node;      // 超出了最大时间的节点，在每次最大表盘归0的时候尝试插入
+	uint32_t late;                 // 当前这一格比实际时间晚了多少毫秒
+	wmHistogram *lateness;         // 不为NULL的时候，记录每个定时器触发晚了多少毫秒
 } wmTimerWheel;
 
 // 初始化时间轮，interval为每帧的间隔，currtime为当前时间
@@ -69,9 +72,11 @@ void wmTimerWheel_add(wmTimerWheel *tw, wmTimerWheel_Node *node, uint32_t ticks)
 // 快速添加
 wmTimerWheel_Node* wmTimerWheel_add_quick(wmTimerWheel *tw, timer_cb_t cb, void *ud, uint32_t ticks);
 // 删除结点
-int wmTimerWheel_del(wmTimerWheel_Node *node);
+int wmTimerWheel_del(wmTimerWheel *tw, wmTimerWheel_Node *node);
 // 更新时间轮
 void wmTimerWheel_update(wmTimerWheel *tw, uint64_t currtime);
+// 距离最近的定时器到期还有多少毫秒，没有定时器返回-1
+int wmTimerWheel_next_timeout(wmTimerWheel *tw);
 // 清空时间轮
 void wmTimerWheel_clear(wmTimerWheel *tw);
 
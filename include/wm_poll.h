@@ -0,0 +1,57 @@
+#ifndef WM_POLL_H
+#define WM_POLL_H
+
+/**
+ * reactor后端
+ * loop只认epoll_event格式的事件，不同的后端负责把自己的结果转换成这个格式
+ */
+#include "header.h"
+
+//io_uring需要内核头文件和系统调用号，缺一个就只能用epoll
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_NODROP)
+#define WM_HAVE_IO_URING 1
+#endif
+#endif
+
+typedef struct _wmPoll_t wmPoll_t;
+
+//后端需要实现的方法
+typedef struct {
+	const char *name;
+	bool edge_triggered; //是否支持EPOLLET，不支持的话WM_LOOP_EDGE会退化成WM_LOOP_AUTO
+	int (*init)(wmPoll_t *poll); //创建后端，失败返回-1
+	void (*free)(wmPoll_t *poll); //释放后端
+	int (*ctl)(wmPoll_t *poll, int op, int fd, struct epoll_event *ev); //op和epoll_ctl一样
+	int (*wait)(wmPoll_t *poll, int timeout); //等待事件，结果放在poll->events里面，返回事件数量
+} wmPoll_backend;
+
+struct _wmPoll_t {
+	int epollfd; //创建的epollfd，io_uring后端的时候是ring的fd
+	int ncap; //epoll回调可以接收最多事件数量，会根据负载自动调整
+	int low_rounds; //连续多少次wait都没用到四分之一的ncap
+	int event_num; // 当前在监听的事件的数量
+	int wait_num; // 正在等待事件的协程数量，Coroutine::wait靠它判断还要不要继续等
+	struct epoll_event *events; //是用来保存epoll返回的事件。
+	const wmPoll_backend *backend; //当前使用的后端
+	void *backend_data; //后端自己的数据
+};
+
+//根据名字获取后端类型，不认识返回-1
+int wmPoll_type_by_name(const char *name);
+//添加修改删除监听
+int wmPoll_ctl(int op, int fd, struct epoll_event *ev);
+//等待事件
+int wmPoll_wait(int timeout);
+//根据这次wait拿到的事件数量调整事件数组大小，events处理完之后再调用
+void wmPoll_adjust(int n);
+
+extern const wmPoll_backend wmPoll_epoll_backend;
+extern const wmPoll_backend wmPoll_poll_backend;
+#ifdef WM_HAVE_IO_URING
+extern const wmPoll_backend wmPoll_io_uring_backend;
+#endif
+
+#endif	/* WM_POLL_H */
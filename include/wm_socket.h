@@ -16,6 +16,9 @@ typedef struct {
 	wmString *write_buffer; //写缓冲区
 	int maxSendBufferSize; //应用层发送缓冲区
 	int events; //loop监听了什么事件
+	int poll_events; //内核里面实际注册着的事件，和events不一样的时候就在loop的pending_list里面
+	int pending; //在loop的pending_list里面的下标，等着同步给内核，-1是不在
+	int ready; //WM_LOOP_EDGE模式下，收到过但还没被消费的就绪事件
 	bool closed; //连接是否关闭
 	bool removed; //连接是否close
 	void *owner; //拥有人，比如connection创建的socket，owner就是这个connection
@@ -56,6 +59,7 @@ typedef struct {
 wmSocket* wmSocket_create(int transport, int loop_type);
 wmSocket* wmSocket_pack(int fd, int transport, int loop_type);
 int wmSocket_read(wmSocket *socket, char *buf, int len, uint32_t timeout);
+int wmSocket_read_nowait(wmSocket *socket, char *buf, int len);
 int wmSocket_send(wmSocket *socket, const void *buf, size_t len);
 int wmSocket_write(wmSocket *socket, const void *buf, size_t len); //不管缓冲区
 int wmSocket_close(wmSocket *socket);
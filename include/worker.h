@@ -42,6 +42,20 @@ typedef struct _wmWorker {
 	zval connections; //保存着当前进程所有的连接
 
 	bool reusePort;//端口复用，默认是true
+	int busyPoll; //忙轮询的时间，微秒，0是关闭
+	long stackSize; //这个worker进程里协程默认的C栈大小，0是用DEFAULT_C_STACK_SIZE
+	long readerStackSize; //连接读协程的C栈大小，0是和stackSize一样
+	bool stacklessRead; //连接不常驻读协程，有数据来了才借一个协程去读
+	int priority; //回调协程的优先级，wmCoroutine_priority，onMessage跟着读协程走
+
+	//过载保护
+	long maxCoroutines; //同时在跑的onMessage协程上限，0是不限制
+	long maxConnections; //连接数上限，0是不限制
+	bool _pauseAccept; //超了上限，accept停着
+	bool _pauseRead; //onMessage协程超了上限，连接的读协程也停着
+	wmCoroutine *_acceptCoro; //停着的accept协程
+	wmTimerWheel_Node *_overloadTimer; //停着的时候定时看看降到低水位没有
+	uint64_t overloadTimes; //一共停过几次
 } wmWorker;
 
 //为了通过php对象，找到上面的c++对象 ======= start
@@ -66,5 +80,6 @@ void wmWorker_stopAll();
 void wmWorker_free(wmWorker *worker);
 wmWorker* wmWorker_find_by_fd(int fd);
 wmWorker* wmWorker_getCurrent();
+bool wmWorker_checkOverload(wmWorker *worker);
 
 #endif
@@ -23,6 +23,7 @@ typedef struct {
 	int transport; //TCP还是UDP
 	bool _isPaused; //暂停接收消息,只对tcp起作用,默认是false
 	wmCoroutine *_pausedCoro; //被暂停的协程
+	bool _reading; //stacklessRead的时候，正在借来的协程里面读
 
 	php_fci_fcc *onMessage;
 	php_fci_fcc *onClose;
@@ -53,6 +54,9 @@ wmConnection* wmConnection_create_udp(int fd);
 wmConnection* wmConnection_find_by_fd(int fd);
 ssize_t wmConnection_recv(wmConnection *socket, int32_t length);
 void wmConnection_read(wmConnection *connection);
+void wmConnection_startStackless(wmConnection *connection);
+void wmConnection_readReady(wmConnection *connection);
+void wmConnection_watchRead(wmConnection *connection);
 void wmConnection_recvfrom(wmConnection *connection, wmSocket *socket);
 bool wmConnection_send(wmConnection *connection, const void *buf, size_t len, bool raw);
 int wmConnection_destroy(wmConnection *connection);
@@ -60,6 +64,7 @@ void wmConnection_free(wmConnection *socket);
 void wmConnection_closeConnections();
 long wmConnection_getConnectionsNum();
 long wmConnection_getTotalRequestNum();
+long wmConnection_getRunningMessageNum();
 void wmConnection_consumeRecvBuffer(wmConnection *connection, zend_long length);
 char* wmConnection_getRemoteIp(wmConnection *connection);
 int wmConnection_getRemotePort(wmConnection *connection);
@@ -9,12 +9,36 @@
  */
 typedef bool (*loop_callback_func_t)(wmSocket*, int);
 
+/**
+ * nextTick的回调，在loop里面执行，不在任何协程里面，不能yield
+ */
+typedef void (*wmWorkerLoop_tick_func_t)(void *data);
+
+/**
+ * loop的运行统计，每个进程一份
+ */
+typedef struct {
+	wmHistogram iteration; //每一轮处理事件和定时器花的时间，微秒，不包括等待
+	wmHistogram wait; //每一轮在epoll_wait里面睡了多久，微秒
+	wmHistogram events; //每次epoll_wait拿到多少事件
+	wmHistogram callback; //每个事件回调花的时间，微秒
+	wmHistogram timer_lateness; //定时器比预定时间晚了多少毫秒
+	wmHistogram spin; //忙轮询每次空转了多久，微秒
+	uint64_t spin_hits; //空转的时候拿到了事件
+	uint64_t spin_misses; //空转完了也没有事件，只能阻塞等待
+} wmWorkerLoop_stats;
+
 bool wmWorkerLoop_set_handler(int event, int type, loop_callback_func_t fn);
 loop_callback_func_t wmWorkerLoop_get_handler(int event, int type);
 bool wmWorkerLoop_add(wmSocket* socket, int event);
 bool wmWorkerLoop_remove(wmSocket* socket, int event);
+void wmWorkerLoop_run(bool until_idle);
 void wmWorkerLoop_loop();
 void wmWorkerLoop_stop();
 bool wmWorkerLoop_del(wmSocket* socket);
+bool wmWorkerLoop_detach(wmSocket* socket);
+void wmWorkerLoop_flush();
+wmWorkerLoop_stats* wmWorkerLoop_get_stats();
+void wmWorkerLoop_nextTick(wmWorkerLoop_tick_func_t fn, void *data);
 
 #endif
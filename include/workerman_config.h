@@ -17,6 +17,8 @@ enum wmSocketError_type {
 enum wmLoop_type {
 	WM_LOOP_AUTO = 1, // 默认是全自动resume和yield，每次都自动添加和删除事件
 	WM_LOOP_SEMI_AUTO = 2, //  send的时候默认resume和yield，read的监听事件需要自己添加
+	WM_LOOP_EDGE = 3, // 边缘触发，只注册一次读写事件，就绪状态缓存在socket上，close的时候才删除
+	WM_LOOP_CALLBACK = 4, // 读事件交给注册的回调处理，没有协程常驻等着读。写和SEMI_AUTO一样
 };
 
 enum wmChannel_opcode {
@@ -24,6 +26,15 @@ enum wmChannel_opcode {
 	CHANNEL_POP = 2,
 };
 
+/**
+ * reactor后端
+ */
+enum wmPoll_type {
+	WM_POLL_EPOLL = 1, //
+	WM_POLL_IO_URING = 2, //需要内核支持，不支持的时候自动退回epoll
+	WM_POLL_POLL = 3, //poll(2)，epoll不能用的环境兜底
+};
+
 /**
  * epoll各种监听事件
  */
@@ -61,13 +72,30 @@ enum wmConnection_status {
 //worker connection
 #define WM_MAX_SEND_BUFFER_SIZE 102400 //默认应用层发送缓冲区大小  1M
 #define WM_MAX_PACKAGE_SIZE 1024000   //每个连接能够接收的最大包包长 10M
+#define WM_WORKER_LOW_WATERMARK 90 //超了maxCoroutines、maxConnections停下来之后，降到上限的百分之多少再恢复
+#define WM_WORKER_OVERLOAD_CHECK_INTERVAL 5 //停着的时候隔多少毫秒看一次降下来没有
+#define WM_CONNECTION_READ_BURST 16 //stacklessRead借一次协程最多读几次，剩下的下一轮loop再读，免得一个连接占着loop
 
 //coroutine.h 默认的PHP栈页大小
 #define DEFAULT_PHP_STACK_PAGE_SIZE       8192
 #define PHP_CORO_TASK_SLOT ((int)((ZEND_MM_ALIGNED_SIZE(sizeof(wmCoroutine)) + ZEND_MM_ALIGNED_SIZE(sizeof(zval)) - 1) / ZEND_MM_ALIGNED_SIZE(sizeof(zval))))
 #define DEFAULT_C_STACK_SIZE          (2 *1024 * 1024)
-
-#define WM_MAXEVENTS            1024   //每次epoll可以返回的事件数量上限
+#define WM_STACK_POOL_MAX             64 //最多缓存多少个用完的C栈，Coroutine::set的stack_pool_max可以改
+#define WM_STACK_POOL_CLASSES         4 //C栈池子最多按几种大小分开缓存
+#define WM_STACK_MIN_SIZE             (16 * 1024) //C栈最小多大
+#define WM_COROUTINE_POOL_MAX         256 //最多缓存多少个用完的wmCoroutine和PHP栈页
+#define WM_COROUTINE_SLOTS_INIT       1024 //cid槽位数组的初始大小，不够就翻倍
+#define WM_COROUTINE_READY_QUEUE_INIT 256 //就绪队列初始长度，必须是2的幂
+#define WM_COROUTINE_READY_BUDGET     1024 //loop每一轮最多从就绪队列恢复多少个协程
+#define WM_COROUTINE_PRIORITIES       3 //优先级有几档，见wmCoroutine_priority
+#define WM_COROUTINE_STARVE_LIMIT     16 //低优先级的就绪队列连着被插队这么多次，就先轮它一个
+#define WM_STATUS_TOP_COROUTINES      3 //status里面每个进程列出CPU时间最多的几个协程
+#define WM_COROUTINE_DUMP_FRAMES      16 //coroutines命令里面每个协程最多打印几层调用栈
+#define WM_STACK_PROFILE_MAX          128 //栈剖析最多按多少个入口函数分开统计，多出来的都算到{other}里面
+
+#define WM_MAXEVENTS            1024   //每次epoll可以返回的事件数量，初始值，负载低的时候也缩回这里
+#define WM_MAXEVENTS_LIMIT      8192   //事件数组能扩到多大，Worker::$maxEvents的默认值
+#define WM_MAXEVENTS_SHRINK_ROUNDS 1024 //连续多少次wait都用不到四分之一，事件数组就缩小一半
 #define WM_BUFFER_SIZE_BIG         65536 //默认一次从管道中读字节长度
 #define WM_BUFFER_SIZE_DEFAULT         512 //初始化的时候的长度
 #define WM_DEFAULT_BACKLOG	102400	//默认listen的时候backlog最大长度，也就是等待accept的队列最大长度
@@ -111,6 +111,17 @@ PHP_METHOD(workerman_connection, read) {
 	RETURN_TRUE
 }
 
+//stacklessRead的时候，loop借来的协程从这里开始读
+PHP_METHOD(workerman_connection, readReady) {
+	wmConnectionObject *connection_object = (wmConnectionObject*) wm_connection_fetch_object(Z_OBJ_P(getThis()));
+	wmConnection *conn = connection_object->connection;
+	if (conn == NULL) {
+		RETURN_FALSE
+	}
+	wmConnection_readReady(conn);
+	RETURN_TRUE
+}
+
 //发送数据
 PHP_METHOD(workerman_connection, send) {
 	wmConnectionObject *connection_object;
@@ -224,6 +235,7 @@ static const zend_function_entry workerman_connection_methods[] = { //
 
 		//私有
 		PHP_ME(workerman_connection, read, arginfo_workerman_connection_void, ZEND_ACC_PRIVATE) //
+		PHP_ME(workerman_connection, readReady, arginfo_workerman_connection_void, ZEND_ACC_PRIVATE) //
 		PHP_FE_END };
 
 /**
@@ -4,12 +4,20 @@
 #include "base.h"
 #include "coroutine.h"
 #include "wm_signal.h"
+#include "loop.h"
+#include "sync.h"
 
 //创建协程接口参数声明
 ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_create, 0, 0, 1) //
 ZEND_ARG_CALLABLE_INFO(0, func, 0)
 ZEND_END_ARG_INFO()
 
+//createWithOptions
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_createWithOptions, 0, 0, 2) //
+ZEND_ARG_INFO(0, options)
+ZEND_ARG_CALLABLE_INFO(0, func, 0)
+ZEND_END_ARG_INFO()
+
 //不需要参数的方法用
 ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_void, 0, 0, 0)	//
 ZEND_END_ARG_INFO()
@@ -29,11 +37,76 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_defer, 0, 0, 1) //
 ZEND_ARG_CALLABLE_INFO(0, func, 0)
 ZEND_END_ARG_INFO()
 
+//stats
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_stats, 0, 0, 0) //
+ZEND_ARG_INFO(0, cid)
+ZEND_END_ARG_INFO()
+
+//top
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_top, 0, 0, 0) //
+ZEND_ARG_INFO(0, num)
+ZEND_END_ARG_INFO()
+
+//parallel
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_parallel, 0, 0, 1) //
+ZEND_ARG_ARRAY_INFO(0, callables, 0)
+ZEND_ARG_INFO(0, concurrency)
+ZEND_ARG_INFO(0, timeout)
+ZEND_END_ARG_INFO()
+
+//getStackProfile
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_getStackProfile, 0, 0, 0) //
+ZEND_ARG_INFO(0, reset)
+ZEND_END_ARG_INFO()
+
+//set
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_set, 0, 0, 1) //
+ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
+//nextTick
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_nextTick, 0, 0, 1) //
+ZEND_ARG_CALLABLE_INFO(0, func, 0)
+ZEND_ARG_INFO(0, coroutine)
+ZEND_END_ARG_INFO()
+
 //sleep
 ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_sleep, 0, 0, 1) //
 ZEND_ARG_INFO(0, seconds)
 ZEND_END_ARG_INFO()
 
+//getContext
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_getContext, 0, 0, 0) //
+ZEND_ARG_INFO(0, cid)
+ZEND_END_ARG_INFO()
+
+//cancel
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_cancel, 0, 0, 1) //
+ZEND_ARG_INFO(0, cid)
+ZEND_END_ARG_INFO()
+
+//isCancelled
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_isCancelled, 0, 0, 0) //
+ZEND_ARG_INFO(0, cid)
+ZEND_END_ARG_INFO()
+
+//setDeadline
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_setDeadline, 0, 0, 1) //
+ZEND_ARG_INFO(0, timeout)
+ZEND_ARG_INFO(0, cid)
+ZEND_END_ARG_INFO()
+
+//setPriority
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_setPriority, 0, 0, 1) //
+ZEND_ARG_INFO(0, priority)
+ZEND_ARG_INFO(0, cid)
+ZEND_END_ARG_INFO()
+
+//getPriority
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_coroutine_getPriority, 0, 0, 0) //
+ZEND_ARG_INFO(0, cid)
+ZEND_END_ARG_INFO()
+
 //协程创建实现
 PHP_FUNCTION(workerman_coroutine_create) {
 	zend_fcall_info fci = empty_fcall_info;
@@ -51,6 +124,60 @@ PHP_FUNCTION(workerman_coroutine_create) {
 	RETURN_LONG(cid);
 }
 
+/**
+ * 创建协程，可以指定C栈
+ * stack_size: C栈大小，字节，会按页对齐，不传就用默认的
+ * hugetlb: 是否用大页，适合很少的几个常驻协程，系统没配置大页的时候退回普通页
+ * inherit_context: 这一个协程是否共用当前协程的context，不传就按Coroutine::set的设置
+ * priority: Coroutine::PRIORITY_HIGH/NORMAL/LOW，不传就跟着当前协程
+ */
+PHP_METHOD(workerman_coroutine, createWithOptions) {
+	zval *options = NULL;
+	zend_fcall_info fci = empty_fcall_info;
+	zend_fcall_info_cache fcc = empty_fcall_info_cache;
+	ZEND_PARSE_PARAMETERS_START(2, -1)
+				Z_PARAM_ARRAY(options)
+				Z_PARAM_FUNC(fci, fcc)
+				Z_PARAM_VARIADIC('*', fci.params, fci.param_count)			//
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	HashTable *vht = Z_ARRVAL_P(options);
+	zval *ztmp = NULL;
+	zend_long stack_size = 0;
+	bool hugetlb = false;
+
+	//stack_size
+	if (php_workerman_array_get_value(vht, "stack_size", ztmp)) {
+		stack_size = zval_get_long(ztmp);
+		if (stack_size < 0) {
+			php_error_docref(NULL, E_WARNING, "stack_size must be greater than or equal to 0");
+			RETURN_FALSE
+		}
+	}
+	//hugetlb
+	if (php_workerman_array_get_value(vht, "hugetlb", ztmp)) {
+		hugetlb = zend_is_true(ztmp);
+	}
+	//inherit_context只对这一次创建生效，创建完改回去
+	bool inherit_context = wmCoroutine_get_inherit_context();
+	if (php_workerman_array_get_value(vht, "inherit_context", ztmp)) {
+		wmCoroutine_set_inherit_context(zend_is_true(ztmp));
+	}
+	//priority
+	if (php_workerman_array_get_value(vht, "priority", ztmp)) {
+		zend_long priority = zval_get_long(ztmp);
+		if (!wmCoroutine_priority_valid(priority)) {
+			php_error_docref(NULL, E_WARNING, "invalid priority " ZEND_LONG_FMT, priority);
+			wmCoroutine_set_inherit_context(inherit_context);
+			RETURN_FALSE
+		}
+		wmCoroutine_set_next_priority((int) priority);
+	}
+	long cid = wmCoroutine_create_ex(&fcc, fci.param_count, fci.params, stack_size, hugetlb);
+	wmCoroutine_set_inherit_context(inherit_context);
+	RETURN_LONG(cid);
+}
+
 //协程yield
 PHP_METHOD(workerman_coroutine, yield) {
 	wmCoroutine_yield();
@@ -118,6 +245,59 @@ PHP_METHOD(workerman_coroutine, defer) {
 	wmCoroutine_defer(defer_fci_fcc);
 }
 
+//nextTick回调结束，释放闭包
+static void nextTick_free(void *data) {
+	php_fci_fcc *fci_fcc = (php_fci_fcc*) data;
+	wm_zend_fci_cache_discard(&fci_fcc->fcc);
+	efree(fci_fcc);
+}
+
+//在新协程里面执行
+static void nextTick_coroutine(void *data) {
+	php_fci_fcc *fci_fcc = (php_fci_fcc*) data;
+	long cid = wmCoroutine_create(&fci_fcc->fcc, 0, NULL);
+	wmCoroutine_set_callback(cid, nextTick_free, fci_fcc);
+}
+
+//直接在loop里面执行，不能yield
+static void nextTick_call(void *data) {
+	php_fci_fcc *fci_fcc = (php_fci_fcc*) data;
+	zval result;
+	fci_fcc->fci.retval = &result;
+	fci_fcc->fci.param_count = 0;
+	fci_fcc->fci.params = NULL;
+	if (zend_call_function(&fci_fcc->fci, &fci_fcc->fcc) != SUCCESS) {
+		php_error_docref(NULL, E_WARNING, "nextTick execute error");
+	} else {
+		zval_ptr_dtor(&result);
+	}
+	if (UNEXPECTED(EG(exception))) {
+		zend_exception_error(EG(exception), E_ERROR);
+	}
+	nextTick_free(fci_fcc);
+}
+
+/**
+ * 放到下一轮loop开始的时候执行
+ * coroutine为false的时候直接在loop里面调用，省掉创建协程，回调里面不能有阻塞的操作
+ */
+PHP_METHOD(workerman_coroutine, nextTick) {
+	zend_fcall_info fci = empty_fcall_info;
+	zend_fcall_info_cache fcc = empty_fcall_info_cache;
+	zend_bool coroutine = 1;
+	ZEND_PARSE_PARAMETERS_START(1, 2)
+				Z_PARAM_FUNC(fci, fcc)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_BOOL(coroutine)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	php_fci_fcc *fci_fcc = (php_fci_fcc*) emalloc(sizeof(php_fci_fcc));
+	fci_fcc->fci = fci;
+	fci_fcc->fcc = fcc;
+	wm_zend_fci_cache_persist(&fci_fcc->fcc);
+	wmWorkerLoop_nextTick(coroutine ? nextTick_coroutine : nextTick_call, fci_fcc);
+	RETURN_TRUE
+}
+
 /**
  * sleep方法
  */
@@ -133,11 +313,502 @@ PHP_METHOD(workerman_coroutine, sleep) {
 		RETURN_FALSE
 	}
 
-	wmCoroutine_sleep(seconds);
+	//被取消或者到了截止时间，提前醒来返回false
+	RETURN_BOOL(wmCoroutine_sleep(seconds));
+}
+
+/**
+ * 协程本地存储，返回一个ArrayObject，不传cid就是当前协程
+ * 协程结束的时候自动释放，不在协程里面返回null
+ */
+PHP_METHOD(workerman_coroutine, getContext) {
+	zend_long cid = 0;
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(cid)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	wmCoroutine *co = cid > 0 ? wmCoroutine_get_by_cid(cid) : wmCoroutine_get_current();
+	if (co == NULL || co->cid <= 0) {
+		RETURN_NULL();
+	}
+	RETURN_ZVAL(wmCoroutine_get_context(co), 1, 0);
+}
+
+/**
+ * 取消一个协程
+ * 正卡在socket读写、channel、sleep、同步原语上的话马上醒来，返回失败；没卡着的话下一次卡住的地方直接失败
+ */
+PHP_METHOD(workerman_coroutine, cancel) {
+	zend_long cid;
+	ZEND_PARSE_PARAMETERS_START(1, 1)
+				Z_PARAM_LONG(cid)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	RETURN_BOOL(wmCoroutine_cancel(wmCoroutine_get_by_cid(cid), WM_ERROR_COROUTINE_CANCELED));
+}
+
+/**
+ * 协程是否被取消了，不传cid就是当前协程，到了截止时间也算
+ */
+PHP_METHOD(workerman_coroutine, isCancelled) {
+	zend_long cid = 0;
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(cid)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	wmCoroutine *co = cid > 0 ? wmCoroutine_get_by_cid(cid) : wmCoroutine_get_current();
+	if (co == NULL) {
+		RETURN_FALSE
+	}
+	RETURN_BOOL(co->cancelled != 0);
+}
+
+/**
+ * 设置截止时间，timeout秒之后取消这个协程，小于等于0是去掉截止时间
+ * 不传cid就是当前协程，之后它创建的协程也用同一个截止时间
+ * 不在协程里面的时候返回false，主协程取消不了
+ */
+PHP_METHOD(workerman_coroutine, setDeadline) {
+	double timeout;
+	zend_long cid = 0;
+	ZEND_PARSE_PARAMETERS_START(1, 2)
+				Z_PARAM_DOUBLE(timeout)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(cid)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	wmCoroutine *co = cid > 0 ? wmCoroutine_get_by_cid(cid) : wmCoroutine_get_current();
+	if (co == NULL) {
+		RETURN_FALSE
+	}
+	RETURN_BOOL(wmCoroutine_set_deadline(co, timeout > 0 ? wm_get_now() + (uint64_t) (timeout * 1000000) : 0));
+}
+
+/**
+ * 改协程的优先级，不传cid就是当前协程
+ * 之后它创建的协程也用这个优先级，已经在就绪队列里面排着的换到新优先级的队尾
+ */
+PHP_METHOD(workerman_coroutine, setPriority) {
+	zend_long priority;
+	zend_long cid = 0;
+	ZEND_PARSE_PARAMETERS_START(1, 2)
+				Z_PARAM_LONG(priority)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(cid)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	if (!wmCoroutine_priority_valid(priority)) {
+		php_error_docref(NULL, E_WARNING, "invalid priority " ZEND_LONG_FMT, priority);
+		RETURN_FALSE
+	}
+	wmCoroutine *co = cid > 0 ? wmCoroutine_get_by_cid(cid) : wmCoroutine_get_current();
+	if (co == NULL) {
+		RETURN_FALSE
+	}
+	wmCoroutine_set_priority(co, (int) priority);
+	RETURN_TRUE
+}
+
+/**
+ * 获取协程的优先级，不传cid就是当前协程，协程不存在返回false
+ */
+PHP_METHOD(workerman_coroutine, getPriority) {
+	zend_long cid = 0;
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(cid)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	wmCoroutine *co = cid > 0 ? wmCoroutine_get_by_cid(cid) : wmCoroutine_get_current();
+	if (co == NULL) {
+		RETURN_FALSE
+	}
+	RETURN_LONG(co->priority);
+}
+
+/**
+ * 设置协程相关的参数
+ * stack_pool_max: 最多缓存多少个用完的C栈，0是不缓存
+ * stack_size: 之后创建的协程默认的C栈大小，Worker里面用Worker->stackSize
+ * task_pool_max: 最多缓存多少个用完的协程结构体和PHP栈页，0是不缓存
+ * ready_budget: loop每一轮最多从就绪队列恢复多少个协程
+ * direct_resume: channel、连接这些地方唤醒协程的时候直接切过去，不进就绪队列
+ * inherit_context: 新协程共用创建它的协程的context
+ * stack_profile: 栈剖析，之后新建的协程刷canary量栈用了多深，Coroutine::getStackProfile()看结果，很费内存只能调试用
+ */
+PHP_METHOD(workerman_coroutine, set) {
+	zval *options = NULL;
+	ZEND_PARSE_PARAMETERS_START(1, 1)
+				Z_PARAM_ARRAY(options)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	HashTable *vht = Z_ARRVAL_P(options);
+	zval *ztmp = NULL;
+
+	//stack_pool_max
+	if (php_workerman_array_get_value(vht, "stack_pool_max", ztmp)) {
+		zend_long v = zval_get_long(ztmp);
+		wmContext_pool_set_max(v > 0 ? (uint32_t) v : 0);
+	}
+
+	//stack_size
+	if (php_workerman_array_get_value(vht, "stack_size", ztmp)) {
+		zend_long v = zval_get_long(ztmp);
+		wmCoroutine_set_stack_size(v > 0 ? (size_t) v : 0);
+	}
+
+	//task_pool_max
+	if (php_workerman_array_get_value(vht, "task_pool_max", ztmp)) {
+		zend_long v = zval_get_long(ztmp);
+		wmCoroutine_set_pool_max(v > 0 ? (uint32_t) v : 0);
+	}
+
+	//ready_budget
+	if (php_workerman_array_get_value(vht, "ready_budget", ztmp)) {
+		zend_long v = zval_get_long(ztmp);
+		wmCoroutine_set_ready_budget(v > 0 ? (uint32_t) v : 0);
+	}
+
+	//direct_resume
+	if (php_workerman_array_get_value(vht, "direct_resume", ztmp)) {
+		wmCoroutine_set_direct_resume(zend_is_true(ztmp));
+	}
+
+	//inherit_context
+	if (php_workerman_array_get_value(vht, "inherit_context", ztmp)) {
+		wmCoroutine_set_inherit_context(zend_is_true(ztmp));
+	}
 
+	//stack_profile
+	if (php_workerman_array_get_value(vht, "stack_profile", ztmp)) {
+		wmContext_set_profile(zend_is_true(ztmp));
+	}
 	RETURN_TRUE
 }
 
+//协程的统计放进数组
+static void coroutine_stats_to_array(zval *zv, wmCoroutine *task) {
+	char name[256];
+	array_init(zv);
+	add_assoc_long(zv, "cid", task->cid);
+	wmCoroutine_get_name(task, name, sizeof(name));
+	add_assoc_string(zv, "name", name);
+	add_assoc_double(zv, "cpu_ms", (double) wmCoroutine_get_cpu_time(task) / 1000000);
+	add_assoc_long(zv, "switches", task->switches);
+	add_assoc_double(zv, "created", (double) task->created / 1000000);
+	add_assoc_double(zv, "elapsed", (double) (wm_get_now() - task->created) / 1000000);
+	add_assoc_double(zv, "deadline", (double) task->deadline / 1000000);
+	add_assoc_long(zv, "cancelled", task->cancelled);
+	add_assoc_string(zv, "priority", (char*) wmCoroutine_get_priority_name(task->priority));
+}
+
+/**
+ * 获取一个协程的统计，不传cid就是当前协程
+ * cpu_ms是这个协程自己跑的时间，不包括它唤起的协程
+ */
+PHP_METHOD(workerman_coroutine, stats) {
+	zend_long cid = 0;
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(cid)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	wmCoroutine *co = cid > 0 ? wmCoroutine_get_by_cid(cid) : wmCoroutine_get_current();
+	if (co == NULL) {
+		RETURN_FALSE
+	}
+	coroutine_stats_to_array(return_value, co);
+}
+
+/**
+ * CPU时间最多的num个协程，从多到少
+ */
+PHP_METHOD(workerman_coroutine, top) {
+	zend_long num = 10;
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(num)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	array_init(return_value);
+	if (num <= 0) {
+		return;
+	}
+	if (num > wmCoroutine_getTotalNum()) {
+		num = wmCoroutine_getTotalNum();
+	}
+	wmCoroutine **list = (wmCoroutine**) emalloc(sizeof(wmCoroutine*) * (num > 0 ? num : 1));
+	int n = wmCoroutine_top(list, num);
+	for (int i = 0; i < n; i++) {
+		zval item;
+		coroutine_stats_to_array(&item, list[i]);
+		add_next_index_zval(return_value, &item);
+	}
+	efree(list);
+}
+
+/**
+ * Coroutine::parallel的状态
+ * 超时的时候调用方先走了，还在跑的协程还要往里面写结果，所以带引用计数，最后一个用完的释放
+ */
+typedef struct {
+	uint32_t refcount; //调用方一个，每个没跑完的协程一个
+	uint32_t num;
+	zval callables; //拷贝一份，调用方走了闭包也还活着
+	zend_fcall_info_cache *fccs;
+	zval *results; //和callables一一对应，IS_UNDEF是还没跑完或者没开始
+	wmWaitGroup wg; //还有几个没跑完
+	wmSemaphore sem; //限制同时跑几个
+	bool bounded;
+} wmCoroutine_parallel;
+
+static void parallel_release(wmCoroutine_parallel *parallel) {
+	if (--parallel->refcount > 0) {
+		return;
+	}
+	for (uint32_t i = 0; i < parallel->num; i++) {
+		zval_ptr_dtor(&parallel->results[i]);
+	}
+	wmWaitGroup_destroy(&parallel->wg);
+	wmSemaphore_destroy(&parallel->sem);
+	zval_ptr_dtor(&parallel->callables);
+	efree(parallel->results);
+	efree(parallel->fccs);
+	efree(parallel);
+}
+
+//一个任务跑完了，结果已经在main_func里面写好了
+static void parallel_done(void *_parallel) {
+	wmCoroutine_parallel *parallel = (wmCoroutine_parallel*) _parallel;
+	if (parallel->bounded) {
+		wmSemaphore_release(&parallel->sem);
+	}
+	wmWaitGroup_add(&parallel->wg, -1);
+	parallel_release(parallel);
+}
+
+//离截止时间还有几秒，没有截止时间是-1，已经过了是0
+static double parallel_remaining(uint64_t deadline) {
+	if (deadline == 0) {
+		return -1;
+	}
+	uint64_t now = wm_get_now();
+	return now < deadline ? (double) (deadline - now) / 1000000 : 0;
+}
+
+/**
+ * 并发跑一组callable，key保持不变，值是返回值，抛了异常的就是异常对象
+ * concurrency: 最多同时跑几个，0是不限制
+ * timeout: 秒，到了就不再开新的，直接返回已经跑完的，没跑完的key不在结果里面
+ */
+PHP_METHOD(workerman_coroutine, parallel) {
+	zval *callables = NULL;
+	zend_long concurrency = 0;
+	double timeout = -1;
+	ZEND_PARSE_PARAMETERS_START(1, 3)
+				Z_PARAM_ARRAY(callables)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(concurrency)
+				Z_PARAM_DOUBLE(timeout)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	if (wmCoroutine_get_current() == NULL) {
+		php_error_docref(NULL, E_WARNING, "must be called in a coroutine");
+		RETURN_FALSE
+	}
+	HashTable *ht = Z_ARRVAL_P(callables);
+	uint32_t num = zend_hash_num_elements(ht);
+	array_init(return_value);
+	if (num == 0) {
+		return;
+	}
+
+	//先都检查一遍，有不能调用的一个都不跑
+	uint32_t i = 0;
+	zval *zv;
+	char *error = NULL;
+	zend_fcall_info_cache *fccs = (zend_fcall_info_cache*) emalloc(sizeof(zend_fcall_info_cache) * num);
+	ZEND_HASH_FOREACH_VAL(ht, zv)
+	{
+		if (!zend_is_callable_ex(zv, NULL, 0, NULL, &fccs[i], &error)) {
+			php_error_docref(NULL, E_WARNING, "callables[%u] is not callable: %s", i, error ? error : "unknown");
+			if (error) {
+				efree(error);
+			}
+			efree(fccs);
+			zval_ptr_dtor(return_value);
+			RETURN_FALSE
+		}
+		if (error) {
+			efree(error);
+			error = NULL;
+		}
+		i++;
+	}
+	ZEND_HASH_FOREACH_END();
+
+	wmCoroutine_parallel *parallel = (wmCoroutine_parallel*) emalloc(sizeof(wmCoroutine_parallel));
+	parallel->refcount = 1;
+	parallel->num = num;
+	ZVAL_COPY(&parallel->callables, callables);
+	parallel->fccs = fccs;
+	parallel->results = (zval*) ecalloc(num, sizeof(zval));
+	for (i = 0; i < num; i++) {
+		ZVAL_UNDEF(&parallel->results[i]);
+	}
+	parallel->bounded = concurrency > 0;
+	wmWaitGroup_init(&parallel->wg, 0);
+	wmSemaphore_init(&parallel->sem, concurrency);
+	uint64_t deadline = timeout > 0 ? wm_get_now() + (uint64_t) (timeout * 1000000) : 0;
+
+	for (i = 0; i < num; i++) {
+		double remaining = parallel_remaining(deadline);
+		if (remaining == 0) {
+			break;
+		}
+		//满了就等一个跑完的把位置让出来
+		if (parallel->bounded && !wmSemaphore_acquire(&parallel->sem, remaining)) {
+			break;
+		}
+		parallel->refcount++;
+		wmWaitGroup_add(&parallel->wg, 1);
+		long cid = wmCoroutine_create_with_result(&parallel->fccs[i], 0, NULL, &parallel->results[i]);
+		wmCoroutine_set_callback(cid, parallel_done, parallel);
+	}
+	if (parallel->wg.count > 0 && parallel_remaining(deadline) != 0) {
+		wmWaitGroup_wait(&parallel->wg, parallel_remaining(deadline));
+	}
+
+	//按原来的key放回去
+	zend_ulong idx;
+	zend_string *key;
+	i = 0;
+	ZEND_HASH_FOREACH_KEY_VAL(Z_ARRVAL(parallel->callables), idx, key, zv)
+	{
+		zval *result = &parallel->results[i++];
+		if (Z_TYPE_P(result) == IS_UNDEF) {
+			continue;
+		}
+		Z_TRY_ADDREF_P(result);
+		if (key) {
+			zend_hash_update(Z_ARRVAL_P(return_value), key, result);
+		} else {
+			zend_hash_index_update(Z_ARRVAL_P(return_value), idx, result);
+		}
+	}
+	ZEND_HASH_FOREACH_END();
+	parallel_release(parallel);
+}
+
+//栈用量的直方图转换成php数组
+static void stack_histogram_to_array(zval *zv, const char *name, wmHistogram *h) {
+	zval item;
+	array_init(&item);
+	add_assoc_long(&item, "max", h->max);
+	add_assoc_double(&item, "mean", wmHistogram_mean(h));
+	add_assoc_long(&item, "p50", wmHistogram_percentile(h, 50));
+	add_assoc_long(&item, "p90", wmHistogram_percentile(h, 90));
+	add_assoc_long(&item, "p99", wmHistogram_percentile(h, 99));
+	add_assoc_zval(zv, name, &item);
+}
+
+/**
+ * 栈剖析的结果，按入口函数分开，单位是字节
+ * suggest_stack_size是最深的时候再留一半余量，按页对齐，可以拿去设Worker->stackSize、readerStackSize
+ * PHP栈第一页扩过页的话，说明DEFAULT_PHP_STACK_PAGE_SIZE小了，扩出来的那部分量不到，建议值只是个下限
+ */
+PHP_METHOD(workerman_coroutine, getStackProfile) {
+	zend_bool reset = 0;
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_BOOL(reset)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	wmCoroutine_stack_profile **list;
+	int num = wmCoroutine_get_stack_profiles(&list);
+	array_init(return_value);
+	for (int i = 0; i < num; i++) {
+		wmCoroutine_stack_profile *profile = list[i];
+		zval item;
+		array_init(&item);
+		add_assoc_long(&item, "count", profile->c_stack.count);
+		add_assoc_long(&item, "stack_size", profile->c_stack_size);
+		stack_histogram_to_array(&item, "c_stack", &profile->c_stack);
+		add_assoc_long(&item, "suggest_stack_size", wmContext_stack_size(profile->c_stack.max + profile->c_stack.max / 2, false));
+		add_assoc_long(&item, "php_page_size", DEFAULT_PHP_STACK_PAGE_SIZE);
+		stack_histogram_to_array(&item, "php_stack", &profile->php_stack);
+		add_assoc_long(&item, "php_overflows", profile->php_overflows);
+		add_assoc_zval(return_value, profile->name, &item);
+	}
+	if (reset) {
+		wmCoroutine_reset_stack_profiles();
+	}
+}
+
+/**
+ * 列出所有协程，在等什么、等了多久、调用栈，查卡住的协程用
+ * state: running、ready、yielded、suspended（唤起了别的协程，等它让出来）
+ * wait: read、write、channel、sleep、sync、paused、accept，直接yield的是yield
+ */
+PHP_METHOD(workerman_coroutine, listAll) {
+	char buf[384];
+	int total = wmCoroutine_getTotalNum();
+	array_init(return_value);
+	if (total <= 0) {
+		return;
+	}
+	wmCoroutine **list = (wmCoroutine**) emalloc(sizeof(wmCoroutine*) * total);
+	int n = wmCoroutine_list(list, total);
+	uint64_t now = wm_get_now();
+	for (int i = 0; i < n; i++) {
+		wmCoroutine *task = list[i];
+		zval item, trace;
+		array_init(&item);
+		add_assoc_long(&item, "cid", task->cid);
+		wmCoroutine_get_name(task, buf, sizeof(buf));
+		add_assoc_string(&item, "name", buf);
+		add_assoc_string(&item, "state", (char*) wmCoroutine_get_state(task));
+		add_assoc_string(&item, "wait", (char*) wmCoroutine_get_wait_name(task));
+		add_assoc_string(&item, "priority", (char*) wmCoroutine_get_priority_name(task->priority));
+		add_assoc_long(&item, "fd", task->yielded ? task->wait_fd : -1);
+		add_assoc_double(&item, "yielded_for", task->yielded ? (double) (now - task->yield_at) / 1000000 : 0);
+		array_init(&trace);
+		for (zend_execute_data *ex = wmCoroutine_get_execute_data(task); ex; ex = ex->prev_execute_data) {
+			if (ex->func == NULL) {
+				continue;
+			}
+			wmCoroutine_get_frame(ex, buf, sizeof(buf));
+			add_next_index_string(&trace, buf);
+		}
+		add_assoc_zval(&item, "trace", &trace);
+		add_next_index_zval(return_value, &item);
+	}
+	efree(list);
+}
+
+/**
+ * 获取协程相关缓存池的统计
+ */
+PHP_METHOD(workerman_coroutine, getPoolStats) {
+	wmContext_pool_stats *stats = wmContext_pool_get_stats();
+	wmCoroutine_pool_stats *co_stats = wmCoroutine_get_pool_stats();
+	array_init(return_value);
+	add_assoc_long(return_value, "stack_num", stats->num);
+	add_assoc_long(return_value, "stack_max", stats->max);
+	add_assoc_long(return_value, "stack_peak", stats->peak);
+	add_assoc_long(return_value, "stack_hits", stats->hits);
+	add_assoc_long(return_value, "stack_misses", stats->misses);
+	add_assoc_long(return_value, "stack_frees", stats->frees);
+	add_assoc_long(return_value, "stack_size", wmCoroutine_get_stack_size());
+	add_assoc_long(return_value, "task_num", co_stats->task_num);
+	add_assoc_long(return_value, "task_hits", co_stats->task_hits);
+	add_assoc_long(return_value, "task_misses", co_stats->task_misses);
+	add_assoc_long(return_value, "page_num", co_stats->page_num);
+	add_assoc_long(return_value, "page_hits", co_stats->page_hits);
+	add_assoc_long(return_value, "page_misses", co_stats->page_misses);
+}
+
+/**
+ * loop缓存的单调时钟，秒，精确到微秒
+ * 只能用来算耗时，不是时间戳
+ */
+PHP_METHOD(workerman_coroutine, now) {
+	RETURN_DOUBLE((double) wm_get_now() / 1000000);
+}
+
 //获取协程cid
 PHP_METHOD(workerman_coroutine, wait) {
 	int ret = wm_event_wait();
@@ -164,6 +835,7 @@ const zend_function_entry workerman_coroutine_methods[] = { //
 		ZEND_FENTRY(create, ZEND_FN(workerman_coroutine_create),
 			arginfo_workerman_coroutine_create,
 			ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) // ZEND_FENTRY这行是新增的
+		PHP_ME(workerman_coroutine, createWithOptions, arginfo_workerman_coroutine_createWithOptions, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
 		PHP_ME(workerman_coroutine, yield, arginfo_workerman_coroutine_void, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
 		PHP_ME(workerman_coroutine, resume, arginfo_workerman_coroutine_resume, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
 		PHP_ME(workerman_coroutine, wait, arginfo_workerman_coroutine_void, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
@@ -171,7 +843,22 @@ const zend_function_entry workerman_coroutine_methods[] = { //
 		PHP_ME(workerman_coroutine, getTotalNum, arginfo_workerman_coroutine_void, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
 		PHP_ME(workerman_coroutine, isExist, arginfo_workerman_coroutine_isExist, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
 		PHP_ME(workerman_coroutine, defer, arginfo_workerman_coroutine_defer, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, stats, arginfo_workerman_coroutine_stats, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, top, arginfo_workerman_coroutine_top, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, set, arginfo_workerman_coroutine_set, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, getPoolStats, arginfo_workerman_coroutine_void, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, listAll, arginfo_workerman_coroutine_void, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, parallel, arginfo_workerman_coroutine_parallel, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, getStackProfile, arginfo_workerman_coroutine_getStackProfile, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, now, arginfo_workerman_coroutine_void, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, nextTick, arginfo_workerman_coroutine_nextTick, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
 		PHP_ME(workerman_coroutine, sleep, arginfo_workerman_coroutine_sleep, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, getContext, arginfo_workerman_coroutine_getContext, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, cancel, arginfo_workerman_coroutine_cancel, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, isCancelled, arginfo_workerman_coroutine_isCancelled, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, setDeadline, arginfo_workerman_coroutine_setDeadline, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, setPriority, arginfo_workerman_coroutine_setPriority, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_coroutine, getPriority, arginfo_workerman_coroutine_getPriority, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
 		PHP_ME(workerman_coroutine, signal_wait, arginfo_workerman_coroutine_void, ZEND_ACC_PRIVATE | ZEND_ACC_STATIC) //
 		PHP_FE_END //
 		};
@@ -193,6 +880,11 @@ void workerman_coroutine_init() {
 	//在zedn中注册类
 	workerman_coroutine_ce_ptr = zend_register_internal_class(&workerman_coroutine_ce TSRMLS_CC); // 在 Zend Engine 中注册
 
+	//优先级
+	zend_declare_class_constant_long(workerman_coroutine_ce_ptr, ZEND_STRL("PRIORITY_HIGH"), WM_PRIORITY_HIGH);
+	zend_declare_class_constant_long(workerman_coroutine_ce_ptr, ZEND_STRL("PRIORITY_NORMAL"), WM_PRIORITY_NORMAL);
+	zend_declare_class_constant_long(workerman_coroutine_ce_ptr, ZEND_STRL("PRIORITY_LOW"), WM_PRIORITY_LOW);
+
 	//短名
 	zend_register_class_alias("Corker", workerman_coroutine_ce_ptr);
 }
@@ -0,0 +1,349 @@
+/**
+ * 协程同步原语入口文件：WaitGroup、Mutex、Semaphore、Barrier
+ */
+#include "base.h"
+#include "sync.h"
+
+zend_class_entry workerman_waitgroup_ce;
+zend_class_entry *workerman_waitgroup_ce_ptr;
+zend_class_entry workerman_mutex_ce;
+zend_class_entry *workerman_mutex_ce_ptr;
+zend_class_entry workerman_semaphore_ce;
+zend_class_entry *workerman_semaphore_ce_ptr;
+zend_class_entry workerman_barrier_ce;
+zend_class_entry *workerman_barrier_ce_ptr;
+
+//c结构直接放在php对象前面，不用另外申请
+typedef struct {
+	wmWaitGroup wg;
+	zend_object std;
+} wmWaitGroupObject;
+
+typedef struct {
+	wmMutex mutex;
+	zend_object std;
+} wmMutexObject;
+
+typedef struct {
+	wmSemaphore sem;
+	zend_object std;
+} wmSemaphoreObject;
+
+typedef struct {
+	wmBarrier barrier;
+	zend_object std;
+} wmBarrierObject;
+
+static zend_object_handlers workerman_waitgroup_handlers;
+static zend_object_handlers workerman_mutex_handlers;
+static zend_object_handlers workerman_semaphore_handlers;
+static zend_object_handlers workerman_barrier_handlers;
+
+static wmWaitGroupObject* wmWaitGroup_fetch_object(zend_object *obj) {
+	return (wmWaitGroupObject*) ((char*) obj - workerman_waitgroup_handlers.offset);
+}
+
+static wmMutexObject* wmMutex_fetch_object(zend_object *obj) {
+	return (wmMutexObject*) ((char*) obj - workerman_mutex_handlers.offset);
+}
+
+static wmSemaphoreObject* wmSemaphore_fetch_object(zend_object *obj) {
+	return (wmSemaphoreObject*) ((char*) obj - workerman_semaphore_handlers.offset);
+}
+
+static wmBarrierObject* wmBarrier_fetch_object(zend_object *obj) {
+	return (wmBarrierObject*) ((char*) obj - workerman_barrier_handlers.offset);
+}
+
+/**
+ * 创建php对象，先按默认值初始化，就算子类没调用父类构造函数也能用
+ */
+static zend_object* wmWaitGroup_create_object(zend_class_entry *ce) {
+	wmWaitGroupObject *wg_t = (wmWaitGroupObject*) ecalloc(1, sizeof(wmWaitGroupObject) + zend_object_properties_size(ce));
+	wmWaitGroup_init(&wg_t->wg, 0);
+	zend_object_std_init(&wg_t->std, ce);
+	object_properties_init(&wg_t->std, ce);
+	wg_t->std.handlers = &workerman_waitgroup_handlers;
+	return &wg_t->std;
+}
+
+static zend_object* wmMutex_create_object(zend_class_entry *ce) {
+	wmMutexObject *mutex_t = (wmMutexObject*) ecalloc(1, sizeof(wmMutexObject) + zend_object_properties_size(ce));
+	wmMutex_init(&mutex_t->mutex);
+	zend_object_std_init(&mutex_t->std, ce);
+	object_properties_init(&mutex_t->std, ce);
+	mutex_t->std.handlers = &workerman_mutex_handlers;
+	return &mutex_t->std;
+}
+
+static zend_object* wmSemaphore_create_object(zend_class_entry *ce) {
+	wmSemaphoreObject *sem_t = (wmSemaphoreObject*) ecalloc(1, sizeof(wmSemaphoreObject) + zend_object_properties_size(ce));
+	wmSemaphore_init(&sem_t->sem, 1);
+	zend_object_std_init(&sem_t->std, ce);
+	object_properties_init(&sem_t->std, ce);
+	sem_t->std.handlers = &workerman_semaphore_handlers;
+	return &sem_t->std;
+}
+
+static zend_object* wmBarrier_create_object(zend_class_entry *ce) {
+	wmBarrierObject *barrier_t = (wmBarrierObject*) ecalloc(1, sizeof(wmBarrierObject) + zend_object_properties_size(ce));
+	wmBarrier_init(&barrier_t->barrier, 1);
+	zend_object_std_init(&barrier_t->std, ce);
+	object_properties_init(&barrier_t->std, ce);
+	barrier_t->std.handlers = &workerman_barrier_handlers;
+	return &barrier_t->std;
+}
+
+/**
+ * 释放php对象，还有协程在等的话按超时放走
+ */
+static void wmWaitGroup_free_object(zend_object *object) {
+	wmWaitGroupObject *wg_t = wmWaitGroup_fetch_object(object);
+	wmWaitGroup_destroy(&wg_t->wg);
+	zend_object_std_dtor(&wg_t->std);
+}
+
+static void wmMutex_free_object(zend_object *object) {
+	wmMutexObject *mutex_t = wmMutex_fetch_object(object);
+	wmMutex_destroy(&mutex_t->mutex);
+	zend_object_std_dtor(&mutex_t->std);
+}
+
+static void wmSemaphore_free_object(zend_object *object) {
+	wmSemaphoreObject *sem_t = wmSemaphore_fetch_object(object);
+	wmSemaphore_destroy(&sem_t->sem);
+	zend_object_std_dtor(&sem_t->std);
+}
+
+static void wmBarrier_free_object(zend_object *object) {
+	wmBarrierObject *barrier_t = wmBarrier_fetch_object(object);
+	wmBarrier_destroy(&barrier_t->barrier);
+	zend_object_std_dtor(&barrier_t->std);
+}
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_sync_void, 0, 0, 0) //
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_sync_wait, 0, 0, 0) //
+ZEND_ARG_INFO(0, timeout)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_waitgroup_construct, 0, 0, 0) //
+ZEND_ARG_INFO(0, count)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_waitgroup_add, 0, 0, 0) //
+ZEND_ARG_INFO(0, delta)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_semaphore_construct, 0, 0, 0) //
+ZEND_ARG_INFO(0, permits)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_barrier_construct, 0, 0, 1) //
+ZEND_ARG_INFO(0, parties)
+ZEND_END_ARG_INFO()
+
+//WaitGroup构造函数
+PHP_METHOD(workerman_waitgroup, __construct) {
+	zend_long count = 0;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(count)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	if (count < 0) {
+		php_error_docref(NULL, E_WARNING, "count must be greater than or equal to 0");
+		count = 0;
+	}
+	wmWaitGroup_fetch_object(Z_OBJ_P(getThis()))->wg.count = count;
+}
+
+PHP_METHOD(workerman_waitgroup, add) {
+	zend_long delta = 1;
+
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(delta)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	RETURN_BOOL(wmWaitGroup_add(&wmWaitGroup_fetch_object(Z_OBJ_P(getThis()))->wg, delta));
+}
+
+PHP_METHOD(workerman_waitgroup, done) {
+	RETURN_BOOL(wmWaitGroup_add(&wmWaitGroup_fetch_object(Z_OBJ_P(getThis()))->wg, -1));
+}
+
+/**
+ * 等计数减到0，超时返回false
+ */
+PHP_METHOD(workerman_waitgroup, wait) {
+	double timeout = -1;
+
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_DOUBLE(timeout)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	RETURN_BOOL(wmWaitGroup_wait(&wmWaitGroup_fetch_object(Z_OBJ_P(getThis()))->wg, timeout));
+}
+
+PHP_METHOD(workerman_waitgroup, count) {
+	RETURN_LONG(wmWaitGroup_fetch_object(Z_OBJ_P(getThis()))->wg.count);
+}
+
+/**
+ * 加锁，拿不到就排队，超时返回false
+ */
+PHP_METHOD(workerman_mutex, lock) {
+	double timeout = -1;
+
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_DOUBLE(timeout)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	RETURN_BOOL(wmMutex_lock(&wmMutex_fetch_object(Z_OBJ_P(getThis()))->mutex, timeout));
+}
+
+PHP_METHOD(workerman_mutex, tryLock) {
+	RETURN_BOOL(wmMutex_trylock(&wmMutex_fetch_object(Z_OBJ_P(getThis()))->mutex));
+}
+
+PHP_METHOD(workerman_mutex, unlock) {
+	RETURN_BOOL(wmMutex_unlock(&wmMutex_fetch_object(Z_OBJ_P(getThis()))->mutex));
+}
+
+PHP_METHOD(workerman_mutex, isLocked) {
+	RETURN_BOOL(wmMutex_fetch_object(Z_OBJ_P(getThis()))->mutex.owner != 0);
+}
+
+//Semaphore构造函数
+PHP_METHOD(workerman_semaphore, __construct) {
+	zend_long permits = 1;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_LONG(permits)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	if (permits < 0) {
+		php_error_docref(NULL, E_WARNING, "permits must be greater than or equal to 0");
+		permits = 0;
+	}
+	wmSemaphore_fetch_object(Z_OBJ_P(getThis()))->sem.permits = permits;
+}
+
+PHP_METHOD(workerman_semaphore, acquire) {
+	double timeout = -1;
+
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_DOUBLE(timeout)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	RETURN_BOOL(wmSemaphore_acquire(&wmSemaphore_fetch_object(Z_OBJ_P(getThis()))->sem, timeout));
+}
+
+PHP_METHOD(workerman_semaphore, tryAcquire) {
+	RETURN_BOOL(wmSemaphore_tryacquire(&wmSemaphore_fetch_object(Z_OBJ_P(getThis()))->sem));
+}
+
+PHP_METHOD(workerman_semaphore, release) {
+	wmSemaphore_release(&wmSemaphore_fetch_object(Z_OBJ_P(getThis()))->sem);
+}
+
+PHP_METHOD(workerman_semaphore, available) {
+	RETURN_LONG(wmSemaphore_fetch_object(Z_OBJ_P(getThis()))->sem.permits);
+}
+
+//Barrier构造函数
+PHP_METHOD(workerman_barrier, __construct) {
+	zend_long parties;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+				Z_PARAM_LONG(parties)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	if (parties < 1 || parties > UINT32_MAX) {
+		php_error_docref(NULL, E_WARNING, "parties must be greater than 0");
+		parties = 1;
+	}
+	wmBarrier_fetch_object(Z_OBJ_P(getThis()))->barrier.parties = parties;
+}
+
+/**
+ * 等凑齐parties个协程一起放行，超时返回false
+ */
+PHP_METHOD(workerman_barrier, wait) {
+	double timeout = -1;
+
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+				Z_PARAM_OPTIONAL
+				Z_PARAM_DOUBLE(timeout)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+
+	RETURN_BOOL(wmBarrier_wait(&wmBarrier_fetch_object(Z_OBJ_P(getThis()))->barrier, timeout));
+}
+
+static const zend_function_entry workerman_waitgroup_methods[] = { //
+	PHP_ME(workerman_waitgroup, __construct, arginfo_workerman_waitgroup_construct, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR) //
+		PHP_ME(workerman_waitgroup, add, arginfo_workerman_waitgroup_add, ZEND_ACC_PUBLIC) //
+		PHP_ME(workerman_waitgroup, done, arginfo_workerman_sync_void, ZEND_ACC_PUBLIC) //
+		PHP_ME(workerman_waitgroup, wait, arginfo_workerman_sync_wait, ZEND_ACC_PUBLIC) //
+		PHP_ME(workerman_waitgroup, count, arginfo_workerman_sync_void, ZEND_ACC_PUBLIC) //
+		PHP_FE_END };
+
+static const zend_function_entry workerman_mutex_methods[] = { //
+	PHP_ME(workerman_mutex, lock, arginfo_workerman_sync_wait, ZEND_ACC_PUBLIC) //
+		PHP_ME(workerman_mutex, tryLock, arginfo_workerman_sync_void, ZEND_ACC_PUBLIC) //
+		PHP_ME(workerman_mutex, unlock, arginfo_workerman_sync_void, ZEND_ACC_PUBLIC) //
+		PHP_ME(workerman_mutex, isLocked, arginfo_workerman_sync_void, ZEND_ACC_PUBLIC) //
+		PHP_FE_END };
+
+static const zend_function_entry workerman_semaphore_methods[] = { //
+	PHP_ME(workerman_semaphore, __construct, arginfo_workerman_semaphore_construct, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR) //
+		PHP_ME(workerman_semaphore, acquire, arginfo_workerman_sync_wait, ZEND_ACC_PUBLIC) //
+		PHP_ME(workerman_semaphore, tryAcquire, arginfo_workerman_sync_void, ZEND_ACC_PUBLIC) //
+		PHP_ME(workerman_semaphore, release, arginfo_workerman_sync_void, ZEND_ACC_PUBLIC) //
+		PHP_ME(workerman_semaphore, available, arginfo_workerman_sync_void, ZEND_ACC_PUBLIC) //
+		PHP_FE_END };
+
+static const zend_function_entry workerman_barrier_methods[] = { //
+	PHP_ME(workerman_barrier, __construct, arginfo_workerman_barrier_construct, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR) //
+		PHP_ME(workerman_barrier, wait, arginfo_workerman_sync_wait, ZEND_ACC_PUBLIC) //
+		PHP_FE_END };
+
+/**
+ * 注册Warriorman\WaitGroup、Mutex、Semaphore、Barrier这几个类
+ */
+void workerman_sync_init() {
+	INIT_NS_CLASS_ENTRY(workerman_waitgroup_ce, "Warriorman", "WaitGroup", workerman_waitgroup_methods);
+	workerman_waitgroup_ce_ptr = zend_register_internal_class(&workerman_waitgroup_ce TSRMLS_CC);
+	memcpy(&workerman_waitgroup_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+	workerman_waitgroup_ce_ptr->create_object = wmWaitGroup_create_object;
+	workerman_waitgroup_handlers.free_obj = wmWaitGroup_free_object;
+	workerman_waitgroup_handlers.offset = (zend_long) (((char*) (&(((wmWaitGroupObject*) NULL)->std))) - ((char*) NULL));
+
+	INIT_NS_CLASS_ENTRY(workerman_mutex_ce, "Warriorman", "Mutex", workerman_mutex_methods);
+	workerman_mutex_ce_ptr = zend_register_internal_class(&workerman_mutex_ce TSRMLS_CC);
+	memcpy(&workerman_mutex_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+	workerman_mutex_ce_ptr->create_object = wmMutex_create_object;
+	workerman_mutex_handlers.free_obj = wmMutex_free_object;
+	workerman_mutex_handlers.offset = (zend_long) (((char*) (&(((wmMutexObject*) NULL)->std))) - ((char*) NULL));
+
+	INIT_NS_CLASS_ENTRY(workerman_semaphore_ce, "Warriorman", "Semaphore", workerman_semaphore_methods);
+	workerman_semaphore_ce_ptr = zend_register_internal_class(&workerman_semaphore_ce TSRMLS_CC);
+	memcpy(&workerman_semaphore_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+	workerman_semaphore_ce_ptr->create_object = wmSemaphore_create_object;
+	workerman_semaphore_handlers.free_obj = wmSemaphore_free_object;
+	workerman_semaphore_handlers.offset = (zend_long) (((char*) (&(((wmSemaphoreObject*) NULL)->std))) - ((char*) NULL));
+
+	INIT_NS_CLASS_ENTRY(workerman_barrier_ce, "Warriorman", "Barrier", workerman_barrier_methods);
+	workerman_barrier_ce_ptr = zend_register_internal_class(&workerman_barrier_ce TSRMLS_CC);
+	memcpy(&workerman_barrier_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+	workerman_barrier_ce_ptr->create_object = wmBarrier_create_object;
+	workerman_barrier_handlers.free_obj = wmBarrier_free_object;
+	workerman_barrier_handlers.offset = (zend_long) (((char*) (&(((wmBarrierObject*) NULL)->std))) - ((char*) NULL));
+}
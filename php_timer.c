@@ -14,6 +14,7 @@ typedef struct {
 	long cid;
 	int ticks;
 	bool persistent; //定时器是否循环
+	int priority; //回调协程的优先级
 	wmTimerWheel_Node* timer;
 	zend_fcall_info_cache fcc;
 	zend_fcall_info fci;
@@ -37,6 +38,13 @@ ZEND_ARG_INFO(0, args1) // 如果是数组，那么后面那个就是持久化
 ZEND_ARG_INFO(0, args2)//
 ZEND_END_ARG_INFO()
 
+//addWithOptions
+ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_timer_addWithOptions, 0, 0, 3) //
+ZEND_ARG_INFO(0, seconds)
+ZEND_ARG_CALLABLE_INFO(0, func, 0)
+ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
 //删除定时器
 ZEND_BEGIN_ARG_INFO_EX(arginfo_workerman_timer_resume, 0, 0, 1) //
 ZEND_ARG_INFO(0, timer_id)
@@ -44,7 +52,7 @@ ZEND_END_ARG_INFO()
 
 static void timer_free(php_worker_timer* timer) {
 	if (timer->timer) {
-		wmTimerWheel_del(timer->timer);
+		wmTimerWheel_del(&WorkerG.timer, timer->timer);
 		timer->timer = NULL;
 	}
 	zend_fcall_info_args_clear(&timer->fci, 1);
@@ -58,6 +66,7 @@ static void timer_free(php_worker_timer* timer) {
 static void timer_add_callback(void* _timer) {
 	php_worker_timer* timer = (php_worker_timer*) _timer;
 	timer->timer = NULL;
+	wmCoroutine_set_next_priority(timer->priority);
 	timer->cid = wmCoroutine_create(&timer->fcc, timer->fci.param_count, timer->fci.params);
 	if (!timer->persistent || wmWorker_getCurrent()->_status == WM_WORKER_STATUS_RELOADING) {
 		timer_free(timer);
@@ -67,23 +76,56 @@ static void timer_add_callback(void* _timer) {
 	timer->timer = wmTimerWheel_add_quick(&WorkerG.timer, timer_add_callback, (void*) timer, timer->ticks);
 }
 
+/**
+ * 参数都检查过了，这里才真正创建定时器
+ * args是传给回调的参数数组，可以是NULL。返回定时器id，失败返回-1
+ */
+static long timer_add(double seconds, zend_fcall_info *fci, zend_fcall_info_cache *fcc, zval *args, bool persistent, int priority) {
+	php_worker_timer* timer = wm_malloc(sizeof(php_worker_timer));
+	timer->timer = NULL;
+	timer->persistent = persistent;
+	timer->priority = priority;
+	timer->fci = *fci;
+	timer->fcc = *fcc;
+	timer->fci.params = NULL;
+	timer->fci.param_count = 0;
+	if (args) {
+		//在这里解析数组
+		zend_fcall_info_args(&timer->fci, args);
+		timer->fci.retval = NULL;
+	}
+	timer->id = ++last_id;
+	timer->ticks = seconds * 1000;
+
+	//fcc的引用计数+1
+	wm_zend_fci_cache_persist(&timer->fcc);
+
+	if (WM_HASH_ADD(WM_HASH_INT_STR, timers, timer->id,timer) < 0) {
+		wmWarn("workerman_timer_add-> fail");
+		timer_free(timer);
+		return -1;
+	}
+	timer->timer = wmTimerWheel_add_quick(&WorkerG.timer, timer_add_callback, (void*) timer, timer->ticks);
+	return timer->id;
+}
+
 //协程创建实现
 PHP_METHOD(workerman_timer, add) {
 	double seconds;
 	zval *args1 = NULL;
 	zval *args2 = NULL;
-	//在这里创建一个定时器
-	php_worker_timer* timer = wm_malloc(sizeof(php_worker_timer));
-	timer->timer = NULL;
-	timer->persistent = true;
+	zval *args = NULL;
+	bool persistent = true;
+	zend_fcall_info fci = empty_fcall_info;
+	zend_fcall_info_cache fcc = empty_fcall_info_cache;
 	//第一个参数表示必传的参数个数，第二个参数表示最多传入的参数个数，-1代表可变参数
 	ZEND_PARSE_PARAMETERS_START(2, 4)
 				Z_PARAM_DOUBLE(seconds)
-				Z_PARAM_FUNC(timer->fci, timer->fcc)
+				Z_PARAM_FUNC(fci, fcc)
 				Z_PARAM_OPTIONAL
 				Z_PARAM_ZVAL(args1)
 				Z_PARAM_ZVAL(args2)
-			ZEND_PARSE_PARAMETERS_END_EX(efree(timer); RETURN_FALSE);
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
 	if (UNEXPECTED(seconds < 0.001)) {
 		php_error_docref(NULL, E_WARNING, "Timer must be greater than or equal to 0.001");
 		RETURN_FALSE
@@ -92,28 +134,72 @@ PHP_METHOD(workerman_timer, add) {
 	if (args1) {
 		if (Z_TYPE_P(args1) == IS_ARRAY) {
 			if (args2 && Z_TYPE_P(args2) == IS_FALSE) {
-				timer->persistent = false;
+				persistent = false;
 			}
-			//在这里解析数组
-			zend_fcall_info_args(&timer->fci, args1);
-			timer->fci.retval = NULL;
+			args = args1;
 		} else if (Z_TYPE_P(args1) == IS_FALSE) {
-			timer->persistent = false;
+			persistent = false;
 		}
 	}
-	timer->id = ++last_id;
-	timer->ticks = seconds * 1000;
+	long id = timer_add(seconds, &fci, &fcc, args, persistent, WM_PRIORITY_NORMAL);
+	if (id < 0) {
+		RETURN_FALSE
+	}
+	RETURN_LONG(id)
+}
 
-	//fcc的引用计数+1
-	wm_zend_fci_cache_persist(&timer->fcc);
+/**
+ * 用选项数组添加定时器
+ * args: 传给回调的参数数组
+ * persistent: 是否循环，默认true
+ * priority: 回调协程的优先级，Coroutine::PRIORITY_HIGH/NORMAL/LOW，默认NORMAL
+ */
+PHP_METHOD(workerman_timer, addWithOptions) {
+	double seconds;
+	zval *options = NULL;
+	zval *args = NULL;
+	bool persistent = true;
+	zend_long priority = WM_PRIORITY_NORMAL;
+	zend_fcall_info fci = empty_fcall_info;
+	zend_fcall_info_cache fcc = empty_fcall_info_cache;
+	ZEND_PARSE_PARAMETERS_START(3, 3)
+				Z_PARAM_DOUBLE(seconds)
+				Z_PARAM_FUNC(fci, fcc)
+				Z_PARAM_ARRAY(options)
+			ZEND_PARSE_PARAMETERS_END_EX(RETURN_FALSE);
+	if (UNEXPECTED(seconds < 0.001)) {
+		php_error_docref(NULL, E_WARNING, "Timer must be greater than or equal to 0.001");
+		RETURN_FALSE
+	}
 
-	if (WM_HASH_ADD(WM_HASH_INT_STR, timers, timer->id,timer) < 0) {
-		wmWarn("workerman_timer_add-> fail");
-		timer_free(timer);
+	HashTable *vht = Z_ARRVAL_P(options);
+	zval *ztmp = NULL;
+
+	//args
+	if (php_workerman_array_get_value(vht, "args", ztmp)) {
+		if (Z_TYPE_P(ztmp) != IS_ARRAY) {
+			php_error_docref(NULL, E_WARNING, "args must be an array");
+			RETURN_FALSE
+		}
+		args = ztmp;
+	}
+	//persistent
+	if (php_workerman_array_get_value(vht, "persistent", ztmp)) {
+		persistent = zend_is_true(ztmp);
+	}
+	//priority
+	if (php_workerman_array_get_value(vht, "priority", ztmp)) {
+		priority = zval_get_long(ztmp);
+		if (!wmCoroutine_priority_valid(priority)) {
+			php_error_docref(NULL, E_WARNING, "invalid priority " ZEND_LONG_FMT, priority);
+			RETURN_FALSE
+		}
+	}
+	long id = timer_add(seconds, &fci, &fcc, args, persistent, (int) priority);
+	if (id < 0) {
 		RETURN_FALSE
 	}
-	timer->timer = wmTimerWheel_add_quick(&WorkerG.timer, timer_add_callback, (void*) timer, timer->ticks);
-	RETURN_LONG(timer->id)
+	RETURN_LONG(id)
 }
 
 //删除定时器
@@ -134,6 +220,7 @@ PHP_METHOD(workerman_timer, del) {
 
 const zend_function_entry workerman_timer_methods[] = { //
 	PHP_ME(workerman_timer, add, arginfo_workerman_timer_add, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
+		PHP_ME(workerman_timer, addWithOptions, arginfo_workerman_timer_addWithOptions, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
 		PHP_ME(workerman_timer, del, arginfo_workerman_timer_resume, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC) //
 		PHP_FE_END //
 		};
@@ -2,6 +2,8 @@
  * worker入口文件
  */
 #include "worker.h"
+#include "loop.h"
+#include "connection.h"
 
 zend_class_entry workerman_worker_ce;
 zend_class_entry *workerman_worker_ce_ptr;
@@ -88,6 +90,7 @@ PHP_METHOD(workerman_worker, listen) {
 	//创建一个新协程
 	zend_fcall_info_cache _listen;
 	wm_get_internal_function(worker_obj->worker->_This, workerman_worker_ce_ptr, ZEND_STRL("_listen"), &_listen);
+	wmCoroutine_set_next_priority(worker_obj->worker->priority);
 	wmCoroutine_create(&_listen, 0, NULL);
 }
 
@@ -108,6 +111,54 @@ PHP_METHOD(workerman_worker, requestNum) {
     RETURN_LONG(num);
 }
 
+//把直方图转换成php数组
+static void histogram_to_array(zval *return_value, const char *name, wmHistogram *h) {
+	zval item;
+	array_init(&item);
+	add_assoc_long(&item, "count", h->count);
+	add_assoc_long(&item, "min", h->min);
+	add_assoc_long(&item, "max", h->max);
+	add_assoc_double(&item, "mean", wmHistogram_mean(h));
+	add_assoc_long(&item, "p50", wmHistogram_percentile(h, 50));
+	add_assoc_long(&item, "p90", wmHistogram_percentile(h, 90));
+	add_assoc_long(&item, "p99", wmHistogram_percentile(h, 99));
+	add_assoc_long(&item, "p999", wmHistogram_percentile(h, 99.9));
+	add_assoc_zval(return_value, name, &item);
+}
+
+/**
+ * loop缓存的单调时钟，秒，精确到微秒
+ * 一轮loop里面拿到的都是同一个值，比microtime便宜，只能用来算耗时
+ */
+PHP_METHOD(workerman_worker, now) {
+	RETURN_DOUBLE((double) wm_get_now() / 1000000);
+}
+
+/**
+ * 获取当前进程event-loop的统计
+ * 时间是微秒，定时器延迟是毫秒
+ */
+PHP_METHOD(workerman_worker, getLoopStats) {
+	wmWorkerLoop_stats *stats = wmWorkerLoop_get_stats();
+	array_init(return_value);
+	histogram_to_array(return_value, "iteration_us", &stats->iteration);
+	histogram_to_array(return_value, "wait_us", &stats->wait);
+	histogram_to_array(return_value, "events_per_wait", &stats->events);
+	histogram_to_array(return_value, "callback_us", &stats->callback);
+	histogram_to_array(return_value, "timer_lateness_ms", &stats->timer_lateness);
+	histogram_to_array(return_value, "spin_us", &stats->spin);
+	add_assoc_long(return_value, "busy_poll_us", WorkerG.busy_poll);
+	add_assoc_long(return_value, "spin_hits", stats->spin_hits);
+	add_assoc_long(return_value, "spin_misses", stats->spin_misses);
+	//过载保护
+	wmWorker *worker = wmWorker_getCurrent();
+	add_assoc_long(return_value, "running_messages", wmConnection_getRunningMessageNum());
+	if (worker) {
+		add_assoc_bool(return_value, "overloaded", worker->_pauseAccept);
+		add_assoc_long(return_value, "overload_times", worker->overloadTimes);
+	}
+}
+
 /**
  *  私有方法，扩展用
  */
@@ -148,6 +199,8 @@ static const zend_function_entry workerman_worker_methods[] = { //
 		PHP_ME(workerman_worker, listen, arginfo_workerman_worker_void, ZEND_ACC_PUBLIC)
 		PHP_ME(workerman_worker, reload, arginfo_workerman_worker_void, ZEND_ACC_PUBLIC)
 		PHP_ME(workerman_worker, requestNum, arginfo_workerman_worker_void, ZEND_ACC_PUBLIC)
+		PHP_ME(workerman_worker, getLoopStats, arginfo_workerman_worker_void, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+		PHP_ME(workerman_worker, now, arginfo_workerman_worker_void, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
 		PHP_ME(workerman_worker, run, arginfo_workerman_worker_void, ZEND_ACC_PRIVATE)
 		PHP_ME(workerman_worker, rename, arginfo_workerman_worker_void, ZEND_ACC_PUBLIC| ZEND_ACC_STATIC)
 		PHP_FE_END };
@@ -185,6 +238,13 @@ void workerman_worker_init() {
 	zend_declare_property_long(workerman_worker_ce_ptr, ZEND_STRL("workerId"), 0, ZEND_ACC_PUBLIC);
 	zend_declare_property_null(workerman_worker_ce_ptr, ZEND_STRL("connections"), ZEND_ACC_PUBLIC);
 	zend_declare_property_bool(workerman_worker_ce_ptr, ZEND_STRL("reusePort"), 1, ZEND_ACC_PUBLIC);
+	zend_declare_property_long(workerman_worker_ce_ptr, ZEND_STRL("busyPoll"), 0, ZEND_ACC_PUBLIC);
+	zend_declare_property_long(workerman_worker_ce_ptr, ZEND_STRL("stackSize"), 0, ZEND_ACC_PUBLIC);
+	zend_declare_property_long(workerman_worker_ce_ptr, ZEND_STRL("readerStackSize"), 0, ZEND_ACC_PUBLIC);
+	zend_declare_property_bool(workerman_worker_ce_ptr, ZEND_STRL("stacklessRead"), 0, ZEND_ACC_PUBLIC);
+	zend_declare_property_long(workerman_worker_ce_ptr, ZEND_STRL("priority"), WM_PRIORITY_NORMAL, ZEND_ACC_PUBLIC);
+	zend_declare_property_long(workerman_worker_ce_ptr, ZEND_STRL("maxCoroutines"), 0, ZEND_ACC_PUBLIC);
+	zend_declare_property_long(workerman_worker_ce_ptr, ZEND_STRL("maxConnections"), 0, ZEND_ACC_PUBLIC);
 	zend_declare_property_long(workerman_worker_ce_ptr, ZEND_STRL("backlog"), WM_DEFAULT_BACKLOG, ZEND_ACC_PUBLIC);
 
 	//静态变量
@@ -192,6 +252,8 @@ void workerman_worker_init() {
 	zend_declare_property_null(workerman_worker_ce_ptr, ZEND_STRL("logFile"), ZEND_ACC_PUBLIC | ZEND_ACC_STATIC);
 	zend_declare_property_null(workerman_worker_ce_ptr, ZEND_STRL("stdoutFile"), ZEND_ACC_PUBLIC | ZEND_ACC_STATIC);
 	zend_declare_property_bool(workerman_worker_ce_ptr, ZEND_STRL("daemonize"), 0, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC);
+	zend_declare_property_string(workerman_worker_ce_ptr, ZEND_STRL("eventLoop"), "epoll", ZEND_ACC_PUBLIC | ZEND_ACC_STATIC);
+	zend_declare_property_long(workerman_worker_ce_ptr, ZEND_STRL("maxEvents"), WM_MAXEVENTS_LIMIT, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC);
 
 	//常量
 	zval VERSION;
@@ -26,6 +26,8 @@ PHP_MINIT_FUNCTION(workerman) {
 	workerman_worker_init();
 	//初始化channel
 	workerman_channel_init();
+	//初始化同步原语
+	workerman_sync_init();
 	//初始化runtime
 	workerman_runtime_init();
 	//初始化定时器
@@ -1,5 +1,6 @@
 #include "base.h"
 #include "coroutine.h"
+#include "loop.h"
 
 wmGlobal_t WorkerG;
 
@@ -7,11 +8,12 @@ wmGlobal_t WorkerG;
  * 请求初始化调用
  */
 void workerman_base_init() {
-	//初始化timer
-	long now_time;
-	wmGetMilliTime(&now_time);
-	wmTimerWheel_init(&WorkerG.timer, 1, now_time);
+	//初始化timer，用单调时钟
+	wmTimerWheel_init(&WorkerG.timer, 1, wm_update_now());
 	WorkerG.is_running = false;
+	WorkerG.poll_type = WM_POLL_EPOLL;
+	WorkerG.max_events = WM_MAXEVENTS_LIMIT;
+	WorkerG.busy_poll = 0;
 	WorkerG.poll = NULL;
 	WorkerG.buffer_stack = wmString_new(512);
 	WorkerG.buffer_stack_large = wmString_new(2048);
@@ -25,90 +27,13 @@ void workerman_base_shutdown() {
 	wmString_free(WorkerG.buffer_stack_large);
 }
 
-//初始化epoll
-int init_wmPoll() {
-	if (!WorkerG.poll) {
-		size_t size;
-		WorkerG.poll = (wmPoll_t*) wm_malloc(sizeof(wmPoll_t));
-		if (WorkerG.poll == NULL) {
-			wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
-			return -1;
-		}
-		WorkerG.poll->epollfd = epoll_create(512); //创建一个epollfd，然后保存在全局变量
-		if (WorkerG.poll->epollfd < 0) {
-			wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
-			wm_free(WorkerG.poll);
-			WorkerG.poll = NULL;
-			return -1;
-		}
-		WorkerG.poll->ncap = WM_MAXEVENTS;
-		size = sizeof(struct epoll_event) * WorkerG.poll->ncap;
-		WorkerG.poll->events = (struct epoll_event*) wm_malloc(size);
-		memset(WorkerG.poll->events, 0, size);
-		WorkerG.poll->event_num = 0; // 事件的数量
-		WorkerG.poll->event = (struct epoll_event*) wm_malloc(sizeof(struct epoll_event));
-	}
-	return 0;
-}
-
-//释放epoll
-int free_wmPoll() {
-	if (WorkerG.poll) {
-		if (close(WorkerG.poll->epollfd) < 0) {
-			wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
-		}
-		wm_free(WorkerG.poll->events);
-		WorkerG.poll->events = NULL;
-		wm_free(WorkerG.poll->event);
-		WorkerG.poll->event = NULL;
-		wm_free(WorkerG.poll);
-		WorkerG.poll = NULL;
-		WorkerG.is_running = false;
-	}
-	return 0;
-}
-
-//普通调度器，server有自己的调度器，不用这个
+/**
+ * Coroutine::wait用的调度器
+ * 和Worker用的是同一个loop，只是没有定时器也没有协程在等事件的时候就退出
+ */
 int wm_event_wait() {
-	init_wmPoll();
-	if (!WorkerG.poll) {
-		wmError("Need to call init_wmPoll() first.");
-	}
-	WorkerG.is_running = true;
-
-	long mic_time;
-	//这里应该改成死循环了
-	while (WorkerG.is_running) {
-		int n;
-		//毫秒级定时器，必须是1
-		int timeout = 1;
-		struct epoll_event *events;
-		events = WorkerG.poll->events;
-		n = epoll_wait(WorkerG.poll->epollfd, events, WorkerG.poll->ncap, timeout);
-		//循环处理epoll请求
-		for (int i = 0; i < n; i++) {
-			int fd;
-			int id;
-			struct epoll_event *p = &events[i];
-			uint64_t u64 = p->data.u64;
-			wmCoroutine *co;
-			//解析出来fd和id
-			fromuint64(u64, &fd, &id);
-			co = wmCoroutine_get_by_cid(id);
-			wmCoroutine_resume(co);
-		}
-		//有定时器才更新
-		if (WorkerG.timer.num > 0) {
-			//获取毫秒
-			wmGetMilliTime(&mic_time);
-			wmTimerWheel_update(&WorkerG.timer, mic_time);
-		} else if (WorkerG.poll->event_num == 0) {
-			WorkerG.is_running = false;
-		}
-
-	}
-	free_wmPoll();
-
+	wmWorkerLoop_run(true);
+	wmWorkerLoop_stop();
 	return 0;
 }
 
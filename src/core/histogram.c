@@ -0,0 +1,54 @@
+#include "histogram.h"
+
+/**
+ * 清空
+ */
+void wmHistogram_reset(wmHistogram *h) {
+	bzero(h, sizeof(wmHistogram));
+}
+
+//格子能放的最大值
+static uint64_t bucket_upper(int index) {
+	if (index < WM_HISTOGRAM_SUB_COUNT) {
+		return (uint64_t) index;
+	}
+	int shift = index / WM_HISTOGRAM_SUB_COUNT - 1;
+	uint64_t lower = ((uint64_t) (WM_HISTOGRAM_SUB_COUNT + index % WM_HISTOGRAM_SUB_COUNT)) << shift;
+	return lower + ((1ULL << shift) - 1);
+}
+
+/**
+ * 百分位数
+ * 格子只知道范围，返回格子的上限，不会比max大
+ */
+uint64_t wmHistogram_percentile(wmHistogram *h, double percentile) {
+	if (h->count == 0) {
+		return 0;
+	}
+	if (percentile >= 100) {
+		return h->max;
+	}
+	uint64_t target = (uint64_t) ((double) h->count * percentile / 100);
+	if (target == 0) {
+		target = 1;
+	}
+	uint64_t seen = 0;
+	for (int i = 0; i < WM_HISTOGRAM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= target) {
+			uint64_t upper = bucket_upper(i);
+			return upper < h->max ? upper : h->max;
+		}
+	}
+	return h->max;
+}
+
+/**
+ * 平均值
+ */
+double wmHistogram_mean(wmHistogram *h) {
+	if (h->count == 0) {
+		return 0;
+	}
+	return (double) h->sum / h->count;
+}
@@ -72,6 +72,12 @@ const char* wmCode_str(int code) {
 	case WM_ERROR_PROTOCOL_FAIL:
 		return "protocol fail";
 		break;
+	case WM_ERROR_COROUTINE_CANCELED:
+		return "coroutine canceled";
+		break;
+	case WM_ERROR_COROUTINE_DEADLINE:
+		return "coroutine deadline exceeded";
+		break;
 	default:
 		snprintf(wm_error, sizeof(wm_error), "Unknown error: %d", code);
 		return wm_error;
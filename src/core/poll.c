@@ -0,0 +1,166 @@
+#include "base.h"
+
+/**
+ * epoll后端
+ */
+static int epoll_backend_init(wmPoll_t *poll) {
+	poll->epollfd = epoll_create1(EPOLL_CLOEXEC); //创建一个epollfd，然后保存在全局变量
+	if (poll->epollfd < 0) {
+		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void epoll_backend_free(wmPoll_t *poll) {
+	if (close(poll->epollfd) < 0) {
+		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+	}
+}
+
+static int epoll_backend_ctl(wmPoll_t *poll, int op, int fd, struct epoll_event *ev) {
+	return epoll_ctl(poll->epollfd, op, fd, ev);
+}
+
+static int epoll_backend_wait(wmPoll_t *poll, int timeout) {
+	return epoll_wait(poll->epollfd, poll->events, poll->ncap, timeout);
+}
+
+const wmPoll_backend wmPoll_epoll_backend = { //
+	"epoll", //
+	true, //
+	epoll_backend_init, //
+	epoll_backend_free, //
+	epoll_backend_ctl, //
+	epoll_backend_wait, //
+};
+
+/**
+ * 根据名字获取后端类型
+ */
+int wmPoll_type_by_name(const char *name) {
+	if (strcasecmp(name, "epoll") == 0) {
+		return WM_POLL_EPOLL;
+	}
+	if (strcasecmp(name, "io_uring") == 0) {
+		return WM_POLL_IO_URING;
+	}
+	if (strcasecmp(name, "poll") == 0) {
+		return WM_POLL_POLL;
+	}
+	return -1;
+}
+
+static const wmPoll_backend* get_backend(int type) {
+	switch (type) {
+	case WM_POLL_IO_URING:
+#ifdef WM_HAVE_IO_URING
+		return &wmPoll_io_uring_backend;
+#else
+		wmWarn("io_uring is not supported by this build, fallback to epoll");
+		return &wmPoll_epoll_backend;
+#endif
+	case WM_POLL_POLL:
+		return &wmPoll_poll_backend;
+	default:
+		return &wmPoll_epoll_backend;
+	}
+}
+
+//初始化epoll
+int init_wmPoll() {
+	if (!WorkerG.poll) {
+		size_t size;
+		WorkerG.poll = (wmPoll_t*) wm_malloc(sizeof(wmPoll_t));
+		if (WorkerG.poll == NULL) {
+			wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+			return -1;
+		}
+		bzero(WorkerG.poll, sizeof(wmPoll_t));
+		WorkerG.poll->ncap = WM_MAXEVENTS < WorkerG.max_events ? WM_MAXEVENTS : WorkerG.max_events;
+		WorkerG.poll->backend = get_backend(WorkerG.poll_type);
+		if (WorkerG.poll->backend->init(WorkerG.poll) < 0) {
+			//io_uring可能被内核或者seccomp禁用了，退回epoll
+			if (WorkerG.poll->backend == &wmPoll_epoll_backend) {
+				wm_free(WorkerG.poll);
+				WorkerG.poll = NULL;
+				return -1;
+			}
+			wmWarn("%s is not available, fallback to epoll", WorkerG.poll->backend->name);
+			WorkerG.poll->backend = &wmPoll_epoll_backend;
+			if (WorkerG.poll->backend->init(WorkerG.poll) < 0) {
+				wm_free(WorkerG.poll);
+				WorkerG.poll = NULL;
+				return -1;
+			}
+		}
+		size = sizeof(struct epoll_event) * WorkerG.poll->ncap;
+		WorkerG.poll->events = (struct epoll_event*) wm_malloc(size);
+		memset(WorkerG.poll->events, 0, size);
+		WorkerG.poll->event_num = 0; // 事件的数量
+	}
+	return 0;
+}
+
+//释放epoll
+int free_wmPoll() {
+	if (WorkerG.poll) {
+		WorkerG.poll->backend->free(WorkerG.poll);
+		wm_free(WorkerG.poll->events);
+		WorkerG.poll->events = NULL;
+		wm_free(WorkerG.poll);
+		WorkerG.poll = NULL;
+		WorkerG.is_running = false;
+	}
+	return 0;
+}
+
+/**
+ * 添加修改删除监听，op和epoll_ctl的一样
+ */
+int wmPoll_ctl(int op, int fd, struct epoll_event *ev) {
+	return WorkerG.poll->backend->ctl(WorkerG.poll, op, fd, ev);
+}
+
+/**
+ * 等待事件，结果在WorkerG.poll->events里面
+ */
+int wmPoll_wait(int timeout) {
+	return WorkerG.poll->backend->wait(WorkerG.poll, timeout);
+}
+
+//重新申请事件数组，失败了就保持原来的大小
+static void events_resize(int ncap) {
+	struct epoll_event *events = (struct epoll_event*) wm_realloc(WorkerG.poll->events, sizeof(struct epoll_event) * ncap);
+	if (events == NULL) {
+		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+		return;
+	}
+	WorkerG.poll->events = events;
+	WorkerG.poll->ncap = ncap;
+}
+
+/**
+ * 根据负载调整事件数组
+ * 一次wait就把数组填满了，说明还有就绪的fd没拿到，翻倍，最多到max_events
+ * 连续很多次都用不到四分之一，减半，最少回到初始大小
+ * 会realloc，所以必须在这一轮的events处理完之后调用
+ */
+void wmPoll_adjust(int n) {
+	wmPoll_t *poll = WorkerG.poll;
+	if (n >= poll->ncap) {
+		poll->low_rounds = 0;
+		if (poll->ncap < WorkerG.max_events) {
+			events_resize(poll->ncap * 2 < WorkerG.max_events ? poll->ncap * 2 : WorkerG.max_events);
+		}
+		return;
+	}
+	if (poll->ncap <= WM_MAXEVENTS || n >= poll->ncap / 4) {
+		poll->low_rounds = 0;
+		return;
+	}
+	if (++poll->low_rounds >= WM_MAXEVENTS_SHRINK_ROUNDS) {
+		poll->low_rounds = 0;
+		events_resize(poll->ncap / 2 > WM_MAXEVENTS ? poll->ncap / 2 : WM_MAXEVENTS);
+	}
+}
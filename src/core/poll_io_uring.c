@@ -0,0 +1,424 @@
+#include "base.h"
+
+#ifdef WM_HAVE_IO_URING
+
+/**
+ * io_uring后端
+ * 用IORING_OP_POLL_ADD做就绪通知，socket的读写逻辑和loop的handler都不用改。
+ * 监听的增删改和触发之后的重新注册都只是写进SQ，等到wait的时候，一次io_uring_enter全部提交，
+ * 顺便把等待和超时也一起做了。
+ * poll是一次性的，触发之后到下一次wait之前再重新注册，
+ * 这样handler里面删掉或者修改的监听，就不用再多提交一次了。
+ */
+
+#define WM_URING_ENTRIES 1024 //SQ的长度，CQ是它的两倍
+#define WM_URING_FDS_SIZE 1024 //fd表初始长度
+#define WM_URING_UDATA_IGNORE ((uint64_t) -1) //remove和timeout的completion，直接忽略
+
+//和__kernel_timespec一样，老的内核头文件里面没有这个结构体
+typedef struct {
+	int64_t tv_sec;
+	long long tv_nsec;
+} wmUring_timespec;
+
+typedef struct {
+	epoll_data_t data; //ctl传进来的数据，原样还给loop
+	uint32_t events; //监听的事件
+	uint32_t gen; //每次修改都加1，用来识别过期的completion
+	bool used; //是否在监听
+	bool armed; //内核里面是否有这个fd的poll
+	bool rearm; //是否已经在重新注册队列里面
+} wmUring_fd;
+
+typedef struct {
+	int ring_fd;
+	//SQ
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned sq_entries;
+	unsigned sq_local_tail; //还没提交给内核的尾巴
+	unsigned sq_pending; //还没提交的sqe数量
+	struct io_uring_sqe *sqes;
+	//CQ
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	//mmap出来的内存
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	//fd表，下标就是fd
+	wmUring_fd *fds;
+	int fds_size;
+	//等待重新注册的fd
+	int *rearm;
+	int rearm_num;
+	int rearm_size;
+} wmUring;
+
+static inline int uring_setup(unsigned entries, struct io_uring_params *p) {
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/**
+ * 提交SQ里面的请求，min_complete大于0的时候会等待completion
+ */
+static int uring_submit(wmUring *ring, unsigned min_complete) {
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+	unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+	int ret = uring_enter(ring->ring_fd, ring->sq_pending, min_complete, flags);
+	if (ret < 0) {
+		return -1;
+	}
+	ring->sq_pending -= ret;
+	return ret;
+}
+
+/**
+ * 拿一个空的sqe，SQ满了就先提交一次
+ */
+static struct io_uring_sqe* uring_get_sqe(wmUring *ring) {
+	unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if (ring->sq_local_tail - head >= ring->sq_entries) {
+		if (uring_submit(ring, 0) < 0) {
+			return NULL;
+		}
+		head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		if (ring->sq_local_tail - head >= ring->sq_entries) {
+			errno = EBUSY;
+			return NULL;
+		}
+	}
+	unsigned idx = ring->sq_local_tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	ring->sq_array[idx] = idx;
+	ring->sq_local_tail++;
+	ring->sq_pending++;
+	return sqe;
+}
+
+static int uring_poll_add(wmUring *ring, int fd) {
+	wmUring_fd *f = &ring->fds[fd];
+	struct io_uring_sqe *sqe = uring_get_sqe(ring);
+	if (!sqe) {
+		return -1;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll_events = f->events;
+	sqe->user_data = touint64(fd, f->gen);
+	f->armed = true;
+	return 0;
+}
+
+static int uring_poll_remove(wmUring *ring, int fd) {
+	wmUring_fd *f = &ring->fds[fd];
+	struct io_uring_sqe *sqe = uring_get_sqe(ring);
+	if (!sqe) {
+		return -1;
+	}
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = touint64(fd, f->gen);
+	sqe->user_data = WM_URING_UDATA_IGNORE;
+	f->armed = false;
+	return 0;
+}
+
+static int uring_fds_resize(wmUring *ring, int fd) {
+	int size = ring->fds_size > 0 ? ring->fds_size : WM_URING_FDS_SIZE;
+	while (size <= fd) {
+		size *= 2;
+	}
+	wmUring_fd *fds = (wmUring_fd*) wm_realloc(ring->fds, sizeof(wmUring_fd) * size);
+	if (fds == NULL) {
+		return -1;
+	}
+	memset(fds + ring->fds_size, 0, sizeof(wmUring_fd) * (size - ring->fds_size));
+	ring->fds = fds;
+	ring->fds_size = size;
+	return 0;
+}
+
+//触发过的fd，放进重新注册队列
+static void uring_rearm_push(wmUring *ring, int fd) {
+	wmUring_fd *f = &ring->fds[fd];
+	if (f->rearm) {
+		return;
+	}
+	if (ring->rearm_num == ring->rearm_size) {
+		int size = ring->rearm_size > 0 ? ring->rearm_size * 2 : WM_URING_FDS_SIZE;
+		int *rearm = (int*) wm_realloc(ring->rearm, sizeof(int) * size);
+		if (rearm == NULL) {
+			wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+			return;
+		}
+		ring->rearm = rearm;
+		ring->rearm_size = size;
+	}
+	f->rearm = true;
+	ring->rearm[ring->rearm_num++] = fd;
+}
+
+//还在监听的fd重新注册，已经删除或者被ctl重新注册过的跳过
+static void uring_rearm_all(wmUring *ring) {
+	for (int i = 0; i < ring->rearm_num; i++) {
+		int fd = ring->rearm[i];
+		wmUring_fd *f = &ring->fds[fd];
+		f->rearm = false;
+		if (f->used && !f->armed) {
+			if (uring_poll_add(ring, fd) < 0) {
+				wmWarn("Error has occurred: fd=%d (errno %d) %s", fd, errno, strerror(errno));
+			}
+		}
+	}
+	ring->rearm_num = 0;
+}
+
+static inline unsigned uring_cq_ready(wmUring *ring) {
+	return __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) - *ring->cq_head;
+}
+
+/**
+ * 收割completion，转换成epoll_event
+ * 一次最多ncap个，剩下的留给下一轮
+ */
+static int uring_reap(wmPoll_t *poll, wmUring *ring) {
+	unsigned head = *ring->cq_head;
+	unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	int n = 0;
+	while (head != tail && n < poll->ncap) {
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+		head++;
+		if (cqe->user_data == WM_URING_UDATA_IGNORE) {
+			continue;
+		}
+		int fd, gen;
+		fromuint64(cqe->user_data, &fd, &gen);
+		if (fd < 0 || fd >= ring->fds_size) {
+			continue;
+		}
+		wmUring_fd *f = &ring->fds[fd];
+		//fd已经删除或者重新注册过了，这个是过期的
+		if (!f->used || f->gen != (uint32_t) gen) {
+			continue;
+		}
+		f->armed = false;
+		//出错了，比如fd被关闭了，不再重新注册
+		if (cqe->res < 0) {
+			continue;
+		}
+		uint32_t revents = (uint32_t) cqe->res;
+		//出错或者挂断的时候，把监听的事件带上，让等待的协程自己去读出错误
+		if (revents & (POLLERR | POLLHUP)) {
+			revents |= f->events & (EPOLLIN | EPOLLOUT);
+		}
+		poll->events[n].events = revents;
+		poll->events[n].data = f->data;
+		n++;
+		uring_rearm_push(ring, fd);
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	return n;
+}
+
+static void uring_destroy(wmUring *ring) {
+	if (ring->sqes && ring->sqes != MAP_FAILED) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+	if (ring->sq_ring && ring->sq_ring != MAP_FAILED) {
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	}
+	if (ring->ring_fd >= 0) {
+		close(ring->ring_fd);
+	}
+	if (ring->fds) {
+		wm_free(ring->fds);
+	}
+	if (ring->rearm) {
+		wm_free(ring->rearm);
+	}
+	wm_free(ring);
+}
+
+static int uring_backend_init(wmPoll_t *poll) {
+	struct io_uring_params p;
+	wmUring *ring = (wmUring*) wm_calloc(1, sizeof(wmUring));
+	if (ring == NULL) {
+		return -1;
+	}
+	bzero(&p, sizeof(p));
+	ring->ring_fd = uring_setup(WM_URING_ENTRIES, &p);
+	if (ring->ring_fd < 0) {
+		wmWarn("io_uring_setup failed: (errno %d) %s", errno, strerror(errno));
+		uring_destroy(ring);
+		return -1;
+	}
+	//需要5.5以上的内核，TIMEOUT按completion数量提前结束和CQ不丢事件都依赖它
+	if (!(p.features & IORING_FEAT_NODROP)) {
+		wmWarn("io_uring of this kernel is too old");
+		uring_destroy(ring);
+		return -1;
+	}
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	bool single_mmap = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		single_mmap = true;
+		if (ring->cq_ring_size > ring->sq_ring_size) {
+			ring->sq_ring_size = ring->cq_ring_size;
+		}
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+#endif
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+		uring_destroy(ring);
+		return -1;
+	}
+	if (single_mmap) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+			uring_destroy(ring);
+			return -1;
+		}
+	}
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe*) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+		uring_destroy(ring);
+		return -1;
+	}
+
+	char *sq = (char*) ring->sq_ring;
+	char *cq = (char*) ring->cq_ring;
+	ring->sq_head = (unsigned*) (sq + p.sq_off.head);
+	ring->sq_tail = (unsigned*) (sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned*) (sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned*) (sq + p.sq_off.array);
+	ring->sq_entries = p.sq_entries;
+	ring->sq_local_tail = *ring->sq_tail;
+	ring->cq_head = (unsigned*) (cq + p.cq_off.head);
+	ring->cq_tail = (unsigned*) (cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned*) (cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+	poll->epollfd = ring->ring_fd;
+	poll->backend_data = ring;
+	return 0;
+}
+
+static void uring_backend_free(wmPoll_t *poll) {
+	uring_destroy((wmUring*) poll->backend_data);
+	poll->backend_data = NULL;
+}
+
+static int uring_backend_ctl(wmPoll_t *poll, int op, int fd, struct epoll_event *ev) {
+	wmUring *ring = (wmUring*) poll->backend_data;
+	if (fd < 0) {
+		errno = EBADF;
+		return -1;
+	}
+	if (fd >= ring->fds_size && uring_fds_resize(ring, fd) < 0) {
+		return -1;
+	}
+	wmUring_fd *f = &ring->fds[fd];
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (f->used) {
+			errno = EEXIST;
+			return -1;
+		}
+		break;
+	case EPOLL_CTL_MOD:
+	case EPOLL_CTL_DEL:
+		if (!f->used) {
+			errno = ENOENT;
+			return -1;
+		}
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+	//内核里面还有旧的poll，先取消
+	if (f->armed && uring_poll_remove(ring, fd) < 0) {
+		return -1;
+	}
+	f->gen++;
+	if (op == EPOLL_CTL_DEL) {
+		f->used = false;
+		f->events = 0;
+		return 0;
+	}
+	f->used = true;
+	f->events = ev->events & (EPOLLIN | EPOLLOUT | EPOLLPRI | EPOLLRDHUP);
+	f->data = ev->data;
+	return uring_poll_add(ring, fd);
+}
+
+static int uring_backend_wait(wmPoll_t *poll, int timeout) {
+	wmUring *ring = (wmUring*) poll->backend_data;
+	wmUring_timespec ts;
+	unsigned min_complete = 0;
+
+	uring_rearm_all(ring);
+	//已经有completion了，就不用等了
+	if (timeout != 0 && uring_cq_ready(ring) == 0) {
+		min_complete = 1;
+		if (timeout > 0) {
+			//off=1，有任何completion这个超时就会提前结束，不会留到下一轮
+			struct io_uring_sqe *sqe = uring_get_sqe(ring);
+			if (sqe) {
+				ts.tv_sec = timeout / 1000;
+				ts.tv_nsec = (long long) (timeout % 1000) * 1000000;
+				sqe->opcode = IORING_OP_TIMEOUT;
+				sqe->fd = -1;
+				sqe->addr = (uint64_t) (uintptr_t) &ts;
+				sqe->len = 1;
+				sqe->off = 1;
+				sqe->user_data = WM_URING_UDATA_IGNORE;
+			} else {
+				//拿不到sqe就不等了，下一轮再来
+				min_complete = 0;
+			}
+		}
+	}
+	if (ring->sq_pending > 0 || min_complete > 0) {
+		if (uring_submit(ring, min_complete) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ETIME) {
+			return -1;
+		}
+	}
+	return uring_reap(poll, ring);
+}
+
+const wmPoll_backend wmPoll_io_uring_backend = { //
+	"io_uring", //
+	false, //POLL_ADD是one-shot的，只能模拟水平触发
+	uring_backend_init, //
+	uring_backend_free, //
+	uring_backend_ctl, //
+	uring_backend_wait, //
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include "base.h"
+
+/**
+ * poll(2)后端
+ * 给没有epoll或者epoll被禁用的环境兜底，比如一些沙箱和老的容器
+ * 每次wait都要把全部fd交给内核，fd多的时候比epoll慢，但是不需要任何额外的内核资源
+ */
+
+#define WM_POLLFD_SIZE 64 //pollfd数组初始长度
+#define WM_POLLFD_DROPPED -2 //slots里面的标记，报过POLLNVAL被后端自己删掉了，loop那边还以为注册着
+
+typedef struct {
+	struct pollfd *pfds; //交给poll的数组，删除的时候用最后一个补上，保持连续
+	epoll_data_t *datas; //和pfds一一对应，ctl传进来的数据，原样还给loop
+	int num;
+	int size;
+	int *slots; //fd对应pfds的下标，-1是没有监听，WM_POLLFD_DROPPED是已经自己删掉了，下标就是fd
+	int slots_size;
+	int start; //就绪的fd比ncap多的时候，下一轮从这里开始找，避免后面的fd饿死
+} wmPollfds;
+
+//epoll的事件和poll的事件互相转换
+static inline short events_to_poll(uint32_t events) {
+	short flag = 0;
+	if (events & EPOLLIN) {
+		flag |= POLLIN;
+	}
+	if (events & EPOLLOUT) {
+		flag |= POLLOUT;
+	}
+	if (events & EPOLLPRI) {
+		flag |= POLLPRI;
+	}
+#ifdef POLLRDHUP
+	if (events & EPOLLRDHUP) {
+		flag |= POLLRDHUP;
+	}
+#endif
+	return flag;
+}
+
+static inline uint32_t events_from_poll(short revents) {
+	uint32_t flag = 0;
+	if (revents & POLLIN) {
+		flag |= EPOLLIN;
+	}
+	if (revents & POLLOUT) {
+		flag |= EPOLLOUT;
+	}
+	if (revents & POLLPRI) {
+		flag |= EPOLLPRI;
+	}
+	if (revents & POLLERR) {
+		flag |= EPOLLERR;
+	}
+	if (revents & POLLHUP) {
+		flag |= EPOLLHUP;
+	}
+#ifdef POLLRDHUP
+	if (revents & POLLRDHUP) {
+		flag |= EPOLLRDHUP;
+	}
+#endif
+	return flag;
+}
+
+static int pollfds_slots_resize(wmPollfds *p, int fd) {
+	int size = p->slots_size > 0 ? p->slots_size : WM_POLLFD_SIZE;
+	while (size <= fd) {
+		size *= 2;
+	}
+	int *slots = (int*) wm_realloc(p->slots, sizeof(int) * size);
+	if (slots == NULL) {
+		return -1;
+	}
+	for (int i = p->slots_size; i < size; i++) {
+		slots[i] = -1;
+	}
+	p->slots = slots;
+	p->slots_size = size;
+	return 0;
+}
+
+static int pollfds_resize(wmPollfds *p) {
+	int size = p->size > 0 ? p->size * 2 : WM_POLLFD_SIZE;
+	struct pollfd *pfds = (struct pollfd*) wm_realloc(p->pfds, sizeof(struct pollfd) * size);
+	if (pfds == NULL) {
+		return -1;
+	}
+	p->pfds = pfds;
+	epoll_data_t *datas = (epoll_data_t*) wm_realloc(p->datas, sizeof(epoll_data_t) * size);
+	if (datas == NULL) {
+		return -1;
+	}
+	p->datas = datas;
+	p->size = size;
+	return 0;
+}
+
+/**
+ * 删掉下标是index的fd，最后一个挪过来补上
+ */
+static void pollfds_remove(wmPollfds *p, int index, int fd) {
+	p->num--;
+	if (index != p->num) {
+		p->pfds[index] = p->pfds[p->num];
+		p->datas[index] = p->datas[p->num];
+		p->slots[p->pfds[index].fd] = index;
+	}
+	p->slots[fd] = -1;
+}
+
+/**
+ * 删掉这一轮报过POLLNVAL的fd，不然下一次poll马上又报，loop就空转了
+ * 报的时候fd取了反做标记，从后往前删，挪过来的都是已经看过的
+ * loop那边之后还会来DEL，标记一下，到时候直接成功，不要报ENOENT
+ */
+static void pollfds_remove_invalid(wmPollfds *p) {
+	int fd;
+	for (int i = p->num - 1; i >= 0; i--) {
+		if (p->pfds[i].fd < 0) {
+			fd = ~p->pfds[i].fd;
+			pollfds_remove(p, i, fd);
+			p->slots[fd] = WM_POLLFD_DROPPED;
+		}
+	}
+}
+
+static int poll_backend_init(wmPoll_t *poll) {
+	wmPollfds *p = (wmPollfds*) wm_calloc(1, sizeof(wmPollfds));
+	if (p == NULL) {
+		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+		return -1;
+	}
+	poll->epollfd = -1;
+	poll->backend_data = p;
+	return 0;
+}
+
+static void poll_backend_free(wmPoll_t *poll) {
+	wmPollfds *p = (wmPollfds*) poll->backend_data;
+	if (p->pfds) {
+		wm_free(p->pfds);
+	}
+	if (p->datas) {
+		wm_free(p->datas);
+	}
+	if (p->slots) {
+		wm_free(p->slots);
+	}
+	wm_free(p);
+	poll->backend_data = NULL;
+}
+
+static int poll_backend_ctl(wmPoll_t *poll, int op, int fd, struct epoll_event *ev) {
+	wmPollfds *p = (wmPollfds*) poll->backend_data;
+	if (fd < 0) {
+		errno = EBADF;
+		return -1;
+	}
+	if (fd >= p->slots_size && pollfds_slots_resize(p, fd) < 0) {
+		return -1;
+	}
+	int index = p->slots[fd];
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (index >= 0) {
+			errno = EEXIST;
+			return -1;
+		}
+		if (p->num == p->size && pollfds_resize(p) < 0) {
+			return -1;
+		}
+		index = p->num++;
+		p->slots[fd] = index;
+		p->pfds[index].fd = fd;
+		break;
+	case EPOLL_CTL_MOD:
+		if (index < 0) {
+			errno = ENOENT;
+			return -1;
+		}
+		break;
+	case EPOLL_CTL_DEL:
+		if (index == WM_POLLFD_DROPPED) {
+			p->slots[fd] = -1;
+			return 0;
+		}
+		if (index < 0) {
+			errno = ENOENT;
+			return -1;
+		}
+		pollfds_remove(p, index, fd);
+		return 0;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+	p->pfds[index].events = events_to_poll(ev->events);
+	p->pfds[index].revents = 0;
+	p->datas[index] = ev->data;
+	return 0;
+}
+
+//参数不能叫poll，会把poll(2)挡住
+static int poll_backend_wait(wmPoll_t *wm_poll, int timeout) {
+	wmPollfds *p = (wmPollfds*) wm_poll->backend_data;
+	int ret = poll(p->pfds, p->num, timeout);
+	if (ret <= 0) {
+		return ret;
+	}
+	int n = 0;
+	int start = p->start;
+	bool invalid = false;
+	if (start >= p->num) {
+		start = 0;
+	}
+	p->start = 0;
+	//从上次停下的地方开始转一圈
+	for (int i = 0; i < p->num && ret > 0; i++) {
+		int index = (start + i) % p->num;
+		struct pollfd *pfd = &p->pfds[index];
+		if (pfd->revents == 0) {
+			continue;
+		}
+		ret--;
+		if (n == wm_poll->ncap) {
+			p->start = index;
+			break;
+		}
+		uint32_t revents = events_from_poll(pfd->revents);
+		//fd不合法，没有办法再等了，当成出错交给等待的协程，报完就删掉
+		if (pfd->revents & POLLNVAL) {
+			revents |= EPOLLERR;
+			pfd->fd = ~pfd->fd;
+			invalid = true;
+		}
+		//只有出错或者挂断的话，和epoll一样把监听的方向也带上，不然loop不会叫醒等着的协程
+		if (revents & (EPOLLERR | EPOLLHUP)) {
+			revents |= events_from_poll(pfd->events) & (EPOLLIN | EPOLLOUT);
+		}
+		wm_poll->events[n].events = revents;
+		wm_poll->events[n].data = p->datas[index];
+		n++;
+	}
+	if (invalid) {
+		pollfds_remove_invalid(p);
+	}
+	return n;
+}
+
+const wmPoll_backend wmPoll_poll_backend = { //
+	"poll", //
+	false, //
+	poll_backend_init, //
+	poll_backend_free, //
+	poll_backend_ctl, //
+	poll_backend_wait, //
+};
@@ -148,3 +148,28 @@ int wm_socket_reuse_port(int fd) {
 	}
 	return ret;
 }
+
+/**
+ * 让内核在这个socket上忙轮询网卡，读的时候少一次软中断唤醒
+ * 需要内核支持，失败了只警告一次，不影响正常使用
+ */
+int wm_socket_busy_poll(int fd, int usec) {
+	static bool warned = false;
+	int ret = -1;
+#ifdef SO_BUSY_POLL
+	ret = setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+#ifdef SO_PREFER_BUSY_POLL
+	if (ret == 0) {
+		int prefer = 1;
+		ret = setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+	}
+#endif
+#else
+	errno = ENOPROTOOPT;
+#endif
+	if (ret < 0 && !warned) {
+		warned = true;
+		wmWarn("Error has occurred: set busy poll failed (fd=%d,errno %d) %s", fd, errno, strerror(errno));
+	}
+	return ret;
+}
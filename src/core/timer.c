@@ -104,7 +104,7 @@ wmTimerWheel_Node* wmTimerWheel_add_quick(wmTimerWheel *tw, timer_cb_t cb, void
 }
 
 // 删除结点
-int wmTimerWheel_del(wmTimerWheel_Node *node) {
+int wmTimerWheel_del(wmTimerWheel *tw, wmTimerWheel_Node *node) {
 	if (!node) {
 		return 1;
 	}
@@ -112,6 +112,8 @@ int wmTimerWheel_del(wmTimerWheel_Node *node) {
 		wmList_remote((wmListNode*) node);
 		wm_free(node);
 		node = NULL;
+		//剩余任务数要同步减掉，否则loop会以为一直有定时器
+		tw->num--;
 		return 1;
 	}
 	php_printf("wmTimerWheel_del error\n");
@@ -187,6 +189,9 @@ void _wmTimerWheelick(wmTimerWheel *tw) {
 		wmList_remote(head.next);
 
 		tw->num--;
+		if (tw->lateness) {
+			wmHistogram_record(tw->lateness, tw->late);
+		}
 		if (node->callback) {
 			//执行回调
 			node->callback(node->userdata);
@@ -207,9 +212,17 @@ void wmTimerWheel_update(wmTimerWheel *tw, uint64_t currtime) {
 		int intv = tw->interval;
 		//lasttime设置为这次传入的时间戳
 		tw->lasttime = currtime;
+		//没有任务的时候不用一格一格的走，直接把滴答数追上来
+		//loop可能睡了很久，这样新加的定时器才是从现在开始计时
+		if (tw->num == 0) {
+			tw->currtick += diff / intv;
+			tw->remainder = diff % intv;
+			return;
+		}
 		//循环滴答，滴答滴答滴答 哈哈哈
 		while (diff >= intv) {
 			diff -= intv;
+			tw->late = diff;
 			_wmTimerWheelick(tw);
 		}
 		//剩余毫秒保存起来
@@ -217,6 +230,68 @@ void wmTimerWheel_update(wmTimerWheel *tw, uint64_t currtime) {
 	}
 }
 
+/**
+ * 在链表里找最早到期的节点，返回还差多少滴答
+ */
+static uint32_t _wmTimerWheel_list_min(wmTimerWheel *tw, wmListNode *head, uint32_t min) {
+	wmListNode *pos;
+	for (pos = head->next; pos != head; pos = pos->next) {
+		uint32_t ticks = ((wmTimerWheel_Node*) pos)->expire - tw->currtick;
+		if (ticks < min) {
+			min = ticks;
+		}
+	}
+	return min;
+}
+
+/**
+ * 距离最近一个定时器到期还有多少毫秒
+ * 没有定时器返回-1，给epoll_wait用就是一直等
+ */
+int wmTimerWheel_next_timeout(wmTimerWheel *tw) {
+	if (tw->num == 0) {
+		return -1;
+	}
+	uint32_t min = UINT32_MAX;
+	int i, j;
+	//第1个轮，第一个不为空的格子就是最早到期的
+	for (i = 1; i < TVR_SIZE; ++i) {
+		if (!wmList_is_empty(tw->tvroot.vec + FIRST_INDEX(tw->currtick + i))) {
+			min = i;
+			break;
+		}
+	}
+	//后面几个轮的节点，最早也要等第1个轮转完这一圈才会降下来
+	uint32_t next_round = TVR_SIZE - FIRST_INDEX(tw->currtick);
+	if (min > next_round) {
+		for (i = 0; i < 4; ++i) {
+			int idx = NTH_INDEX(tw->currtick, i);
+			//从下一个刻度开始往后找，转一整圈
+			for (j = 1; j <= TVN_SIZE; ++j) {
+				wmListNode *head = tw->tv[i].vec + ((idx + j) & TVN_MASK);
+				if (!wmList_is_empty(head)) {
+					min = _wmTimerWheel_list_min(tw, head, min);
+					break;
+				}
+			}
+		}
+		min = _wmTimerWheel_list_min(tw, &tw->so_long_node, min);
+	}
+	if (min == UINT32_MAX) {
+		//理论上不会走到这里，保险起见等一圈
+		min = next_round;
+	}
+	//换算成毫秒，减掉已经走过的零头
+	int64_t timeout = (int64_t) min * tw->interval - tw->remainder;
+	if (timeout < 0) {
+		return 0;
+	}
+	if (timeout > INT_MAX) {
+		return INT_MAX;
+	}
+	return (int) timeout;
+}
+
 /**
  * 清空定时器
  */
@@ -244,7 +319,7 @@ void wmTimerWheel_clear(wmTimerWheel *tw) {
 		for (j = 0; j < TVN_SIZE; ++j) {
 			//双向链表
 			wmList_init(&head);
-			wmList_splice(tw->tvroot.vec + j, &head);
+			wmList_splice(tw->tv[i].vec + j, &head);
 			//循环清空
 			while (!wmList_is_empty(&head)) {
 				//拿出先加入的节点
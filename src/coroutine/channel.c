@@ -3,11 +3,15 @@
 
 static void sleep_timeout(void *param);
 
-//这个结构体，是用来控制协程，不在错误的时间co->resume的
+/**
+ * 等待中的协程，放在它自己的栈上，等完就没了
+ * 定时器到了会把timer置空、timeout置true，没到的话醒来的时候把定时器删掉
+ */
 typedef struct {
 	wmCoroutine* co;
-	bool type; //是否需要被唤醒
-} WmChannelCoroutineType;
+	wmTimerWheel_Node *timer;
+	bool timeout;
+} wmChannel_waiter;
 
 wmChannel* wmChannel_create(uint32_t _capacity) {
 	wmChannel* channel = (wmChannel *) wm_malloc(sizeof(wmChannel));
@@ -19,29 +23,40 @@ wmChannel* wmChannel_create(uint32_t _capacity) {
 	return channel;
 }
 
+/**
+ * 在queue里面排队等，直到cond不成立、超时、协程被取消或者channel关了
+ * 唤醒是走就绪队列的，醒来之前数据可能已经被别的协程拿走了，所以要循环等
+ */
+#define channel_wait(channel, queue, cond, timeout) do { \
+	wmChannel_waiter waiter = { wmCoroutine_get_current(), NULL, false }; \
+	if (timeout > 0) { \
+		waiter.timer = wmTimerWheel_add_quick(&WorkerG.timer, sleep_timeout, (void*) &waiter, timeout * 1000); \
+	} \
+	do { \
+		wmQueue_push(queue, waiter.co); \
+		wmCoroutine_set_wait(WM_WAIT_CHANNEL, -1); \
+		/* 协程被取消了，和超时一样处理 */ \
+		if (!wmCoroutine_yield_cancelable()) { \
+			waiter.timeout = true; \
+			break; \
+		} \
+	} while ((cond) && !waiter.timeout && !channel->closed); \
+	if (waiter.timer) { \
+		wmTimerWheel_del(&WorkerG.timer, waiter.timer); \
+	} \
+	/* 超时醒来的，还在队列里面排着，拿出来，不然以后会被错误的唤醒 */ \
+	if (waiter.timeout) { \
+		wmQueue_remove(queue, waiter.co); \
+	} \
+} while (0)
+
 //插入
 bool wmChannel_push(wmChannel* channel, void *data, double timeout) {
-	//获取当前协程
-	wmCoroutine *co = wmCoroutine_get_current();
+	wmCoroutine *co;
 	//如果当前channel内容，已到channel上限
 	if (channel->data_queue->num == channel->capacity) {
-		WmChannelCoroutineType* wct = NULL;
-		//如果设置了超时时间
-		if (timeout > 0) {
-			wct = (WmChannelCoroutineType *) wm_malloc(sizeof(WmChannelCoroutineType));
-			wct->co = co;
-			wct->type = true;
-			//就添加到定时器中,定时器到时间，会把当前这个协程再唤醒
-			wmTimerWheel_add_quick(&WorkerG.timer, sleep_timeout, (void*) wct, timeout * 1000);
-		}
-		//把当前协程，加入生产者协程等待队列中
-		wmQueue_push(channel->producer_queue, co);
 		//协程暂时yield，等待定时器超时时间结束，或者消费者通知
-		wmCoroutine_yield(co);
-		//协程已经醒了，就不需要被唤醒了
-		if (wct) {
-			wct->type = false;
-		}
+		channel_wait(channel, channel->producer_queue, channel->data_queue->num == channel->capacity, timeout);
 	}
 
 	// 定时器结束，或者未设置timeout
@@ -49,7 +64,7 @@ bool wmChannel_push(wmChannel* channel, void *data, double timeout) {
 	/**
 	 * 这个时候如果channel还是满的，那直接返回false，我存不进去
 	 */
-	if (channel->data_queue->num == channel->capacity) {
+	if (channel->closed || channel->data_queue->num == channel->capacity) {
 		return false;
 	}
 
@@ -66,7 +81,8 @@ bool wmChannel_push(wmChannel* channel, void *data, double timeout) {
 		if (!co) {
 			continue;
 		}
-		wmCoroutine_resume(co);
+		//放进就绪队列，不在这里套一层resume
+		wmCoroutine_ready(co);
 		break;
 	}
 	//消费者协程退出控制权的话，那么这边也返回
@@ -75,34 +91,18 @@ bool wmChannel_push(wmChannel* channel, void *data, double timeout) {
 
 //弹出
 void* wmChannel_pop(wmChannel* channel, double timeout) {
-	//获取当前协程
-	wmCoroutine *co = wmCoroutine_get_current();
+	wmCoroutine *co;
 	//准备接受pop的数据
 	void *data;
 
 	//如果当前channel已经空了,也就是弹不出来了
 	if (channel->data_queue->num == 0) {
-		WmChannelCoroutineType* wct = NULL;
-		//如果设置了超时时间
-		if (timeout > 0) {
-			wct = (WmChannelCoroutineType *) wm_malloc(sizeof(WmChannelCoroutineType));
-			wct->co = co;
-			wct->type = true;
-			//就添加到定时器中,定时器到时间，会把这个协程再唤醒
-			wmTimerWheel_add_quick(&WorkerG.timer, sleep_timeout, (void*) wct, timeout * 1000);
-		}
-		//加入消费者等待队列中
-		wmQueue_push(channel->consumer_queue, co);
-		//协程暂时yield，等待定时器超时时间结束
-		wmCoroutine_yield(co);
-		//协程已经醒了，就不需要被定时器唤醒了
-		if (wct) {
-			wct->type = false;
-		}
+		//加入消费者等待队列中，等待定时器超时时间结束，或者生产者通知
+		channel_wait(channel, channel->consumer_queue, channel->data_queue->num == 0, timeout);
 	}
 
 	//协程timeout恢复运行的时候.如果还是没有等到channel数据，那么返回空
-	if (channel->data_queue->num == 0) {
+	if (channel->closed || channel->data_queue->num == 0) {
 		return NULL;
 	}
 
@@ -113,14 +113,13 @@ void* wmChannel_pop(wmChannel* channel, double timeout) {
 	 * 通知生产者
 	 */
 	while (channel->producer_queue->num > 0) {
-		//然后如果有生产者协程在等待，那么就resume那个生产者协程。
-		//最后，等生产者协程执行完毕，或者生产者协程主动yield，才会回到消费者协程，最后返回data。
+		//然后如果有生产者协程在等待，那么就唤醒那个生产者协程。
 		co = (wmCoroutine*) wmQueue_pop(channel->producer_queue);
 		//如果这个生产者，等不及已经退出了
 		if (!co) {
 			continue;
 		}
-		wmCoroutine_resume(co);
+		wmCoroutine_ready(co);
 		break;
 	}
 	return data;
@@ -146,6 +145,8 @@ void wmChannel_clear(wmChannel* channel) {
 void wmChannel_free(wmChannel* channel) {
 	wmChannel_clear(channel);
 	//唤醒所有，告诉他们不用等了。channel死了
+	//channel马上就释放了，必须直接resume，不能进就绪队列
+	channel->closed = true;
 	wmCoroutine* co;
 	while (channel->consumer_queue->num > 0) {
 		co = (wmCoroutine*) wmQueue_pop(channel->consumer_queue);
@@ -172,15 +173,9 @@ void wmChannel_free(wmChannel* channel) {
  * 超时
  */
 void sleep_timeout(void *param) {
-	WmChannelCoroutineType * wct = ((WmChannelCoroutineType *) param);
-	wmCoroutine * co = wct->co;
-	bool type = wct->type;
-	wm_free(wct);
-	wct = NULL;
-	//是否需要被唤醒
-	if (type) {
-		//让协程恢复原来的执行状态
-		wmCoroutine_resume(co);
-	}
+	wmChannel_waiter *waiter = (wmChannel_waiter*) param;
+	waiter->timer = NULL;
+	waiter->timeout = true;
+	//让协程恢复原来的执行状态
+	wmCoroutine_resume(waiter->co);
 }
-
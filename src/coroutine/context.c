@@ -3,17 +3,193 @@
 
 static void wmContext_func(void *arg);
 
+/**
+ * C栈是mmap出来的，最低的地方留一页PROT_NONE做保护页，栈溢出直接段错误，不会踩坏别的内存
+ * 带MAP_NORESERVE，只有真正用到的页才占内存，默认2M的栈空闲的时候也就几页
+ *
+ * 用完的C栈不还给系统，按大小挂在几个单链表上，下一个协程直接拿来用
+ * 链表节点就放在栈顶，栈顶那一页反正是用过的，不会多占内存，复用的时候不清零
+ * hugetlb的栈不缓存，直接还给系统
+ *
+ * 开了栈剖析的时候，新栈整个刷成WM_STACK_CANARY，destroy的时候从栈底往上找第一个被改过的地方，就是用到的最深处
+ * 刷canary会把整个栈都变成真正占用的内存，只能调试的时候开
+ */
+typedef struct _wmContext_stack {
+	struct _wmContext_stack *next;
+	uint32_t dirty; //栈顶往下多少字节可能不是canary了，复用的时候只用重刷这一段
+} wmContext_stack;
+
+typedef struct {
+	size_t size; //这个链表里面栈的大小
+	wmContext_stack *head;
+	uint32_t num;
+} wmContext_stack_list;
+
+static wmContext_stack_list stack_pool[WM_STACK_POOL_CLASSES];
+static wmContext_pool_stats pool_stats = { 0, WM_STACK_POOL_MAX, 0, 0, 0, 0 };
+static size_t page_size = 0;
+static bool profile = false;
+
+#define WM_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define stack_guard_size(hugetlb) ((hugetlb) ? WM_HUGE_PAGE_SIZE : page_size)
+//栈顶的链表节点和栈底之间互相换算
+#define stack_to_node(stack, size) ((wmContext_stack*) ((stack) + (size) - sizeof(wmContext_stack)))
+#define node_to_stack(node, size) ((char*) (node) + sizeof(wmContext_stack) - (size))
+
+/**
+ * 栈大小对齐到页，不能小于WM_STACK_MIN_SIZE
+ */
+size_t wmContext_stack_size(size_t stack_size, bool hugetlb) {
+	if (page_size == 0) {
+		page_size = sysconf(_SC_PAGESIZE);
+	}
+	if (stack_size < WM_STACK_MIN_SIZE) {
+		stack_size = WM_STACK_MIN_SIZE;
+	}
+	size_t align = hugetlb ? WM_HUGE_PAGE_SIZE : page_size;
+	return (stack_size + align - 1) / align * align;
+}
+
+//找这个大小的链表，没有就占一个空的
+static wmContext_stack_list* stack_list_get(size_t stack_size, bool create) {
+	wmContext_stack_list *empty = NULL;
+	for (int i = 0; i < WM_STACK_POOL_CLASSES; i++) {
+		if (stack_pool[i].size == stack_size) {
+			return &stack_pool[i];
+		}
+		if (empty == NULL && stack_pool[i].num == 0) {
+			empty = &stack_pool[i];
+		}
+	}
+	if (create && empty) {
+		empty->size = stack_size;
+		return empty;
+	}
+	return NULL;
+}
+
+static char* stack_mmap(size_t stack_size, bool *hugetlb) {
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK;
+	size_t guard;
+	char *base;
+#ifdef MAP_HUGETLB
+	if (*hugetlb) {
+		//大页不带MAP_NORESERVE，预留不到的话mmap直接失败，不会在用的时候SIGBUS
+		guard = stack_guard_size(true);
+		base = (char*) mmap(NULL, stack_size + guard, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+		if (base != MAP_FAILED) {
+			if (mprotect(base, guard, PROT_NONE) < 0) {
+				wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+			}
+			return base + guard;
+		}
+		//没有配置大页，退回普通页，按大页对齐的大小肯定也是按普通页对齐的
+	}
+#endif
+	*hugetlb = false;
+	guard = stack_guard_size(false);
+	base = (char*) mmap(NULL, stack_size + guard, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED) {
+		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+		return NULL;
+	}
+	if (mprotect(base, guard, PROT_NONE) < 0) {
+		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+	}
+	return base + guard;
+}
+
+static void stack_munmap(char *stack, size_t stack_size, bool hugetlb) {
+	size_t guard = stack_guard_size(hugetlb);
+	if (munmap(stack - guard, stack_size + guard) < 0) {
+		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+	}
+}
+
+static char* stack_alloc(size_t stack_size, bool *hugetlb, uint32_t *dirty) {
+	if (!*hugetlb) {
+		wmContext_stack_list *list = stack_list_get(stack_size, false);
+		if (list && list->head) {
+			wmContext_stack *node = list->head;
+			list->head = node->next;
+			list->num--;
+			pool_stats.num--;
+			pool_stats.hits++;
+			*dirty = node->dirty;
+			return node_to_stack(node, stack_size);
+		}
+	}
+	pool_stats.misses++;
+	*dirty = stack_size;
+	return stack_mmap(stack_size, hugetlb);
+}
+
+static void stack_release(char *stack, size_t stack_size, bool hugetlb, uint32_t dirty) {
+	wmContext_stack_list *list = NULL;
+	if (!hugetlb && pool_stats.num < pool_stats.max) {
+		list = stack_list_get(stack_size, true);
+	}
+	if (list == NULL) {
+		pool_stats.frees++;
+		stack_munmap(stack, stack_size, hugetlb);
+		return;
+	}
+	wmContext_stack *node = stack_to_node(stack, stack_size);
+	node->next = list->head;
+	node->dirty = dirty > sizeof(wmContext_stack) ? dirty : sizeof(wmContext_stack);
+	list->head = node;
+	list->num++;
+	pool_stats.num++;
+	if (pool_stats.num > pool_stats.peak) {
+		pool_stats.peak = pool_stats.num;
+	}
+}
+
+//从start开始刷size字节的canary
+static void stack_paint(char *start, size_t size) {
+	uint64_t *p = (uint64_t*) start;
+	uint64_t *end = (uint64_t*) (start + size);
+	while (p < end) {
+		*p++ = WM_STACK_CANARY;
+	}
+}
+
+/**
+ * 栈是往下长的，从栈底往上第一个不是canary的地方到栈顶，就是用过的深度
+ */
+static uint32_t stack_measure(char *stack, size_t stack_size) {
+	uint64_t *p = (uint64_t*) stack;
+	uint64_t *end = (uint64_t*) (stack + stack_size);
+	while (p < end && *p == WM_STACK_CANARY) {
+		p++;
+	}
+	return (uint32_t) ((char*) end - (char*) p);
+}
+
 /**
  * 初始化Context
+ * stack_size要先用wmContext_stack_size对齐，hugetlb申请不到的时候会退回普通页
  */
-void wmContext_init(wmContext *ctx, size_t stack_size, coroutine_func_t fn, void* private_data) {
+bool wmContext_init(wmContext *ctx, size_t stack_size, bool hugetlb, coroutine_func_t fn, void* private_data) {
 	ctx->end_ = false;
-	ctx->stack_size_ = stack_size;
 	ctx->private_data_ = private_data;
 	ctx->fn_ = fn;
 	ctx->swap_ctx_ = NULL;
-	//是创建一个C栈（实际上是从堆中分配的内存）。
-	ctx->stack_ = (char*) wm_malloc(ctx->stack_size_);
+	ctx->hugetlb_ = hugetlb;
+	ctx->stack_size_ = stack_size;
+	ctx->profiled_ = false;
+	ctx->stack_used_ = 0;
+	uint32_t dirty;
+	//是创建一个C栈（mmap出来的），池子里有就直接拿
+	ctx->stack_ = stack_alloc(stack_size, &ctx->hugetlb_, &dirty);
+	if (ctx->stack_ == NULL) {
+		return false;
+	}
+	//上次刷过canary也量过的栈，只有上次用到的那一段要重刷
+	if (profile) {
+		stack_paint(ctx->stack_ + stack_size - dirty, dirty);
+		ctx->profiled_ = true;
+	}
 
 	//传入模拟的stack的结束指针位置
 	//代码是把堆模拟成栈的行为。与之前PHP栈的操作类似。
@@ -22,6 +198,7 @@ void wmContext_init(wmContext *ctx, size_t stack_size, coroutine_func_t fn, void
 	//这行代码是设置这个最底层的协程的上下文ctx_，比如栈地址，栈大小，协程的入口函数context_func。
 	//而make_fcontext这个设置上下文的函数式用的boost.asm里面的库。
 	ctx->ctx_ = make_fcontext(sp, ctx->stack_size_, (void (*)(intptr_t)) &wmContext_func); //
+	return true;
 }
 
 /**
@@ -63,9 +240,56 @@ bool wmContext_swap_out(wmContext *ctx) {
 //每次删除所创建的对象时执行
 void wmContext_destroy(wmContext *ctx) {
 	if (ctx->stack_) {
-		//施放内存
-		wm_free(ctx->stack_);
+		//没量过的栈，不知道哪里被改过，下次要整个重刷
+		uint32_t dirty = ctx->stack_size_;
+		if (ctx->profiled_) {
+			ctx->stack_used_ = stack_measure(ctx->stack_, ctx->stack_size_);
+			dirty = ctx->stack_used_;
+		}
+		//施放内存，池子没满就放回去
+		stack_release(ctx->stack_, ctx->stack_size_, ctx->hugetlb_, dirty);
 		ctx->stack_ = NULL;
 	}
+}
+
+/**
+ * 设置C栈池子最多缓存几个，多出来的马上释放
+ */
+void wmContext_pool_set_max(uint32_t max) {
+	pool_stats.max = max;
+	for (int i = 0; i < WM_STACK_POOL_CLASSES && pool_stats.num > max; i++) {
+		wmContext_stack_list *list = &stack_pool[i];
+		while (list->head && pool_stats.num > max) {
+			wmContext_stack *node = list->head;
+			list->head = node->next;
+			list->num--;
+			pool_stats.num--;
+			pool_stats.frees++;
+			stack_munmap(node_to_stack(node, list->size), list->size, false);
+		}
+	}
+}
+
+wmContext_pool_stats* wmContext_pool_get_stats() {
+	return &pool_stats;
+}
+
+/**
+ * 释放池子里所有的C栈，请求结束的时候调用
+ */
+void wmContext_pool_clear() {
+	uint32_t max = pool_stats.max;
+	wmContext_pool_set_max(0);
+	pool_stats.max = max;
+}
+
+/**
+ * 打开栈剖析，之后新建的协程才会刷canary
+ */
+void wmContext_set_profile(bool enable) {
+	profile = enable;
+}
 
+bool wmContext_get_profile() {
+	return profile;
 }
@@ -1,12 +1,70 @@
 #include "coroutine.h"
+#include "ext/spl/spl_array.h"
 
-static long last_cid = 0; //自增id
 static long total_num = 0; //协程总数
-static wmHash_INT_PTR *coroutines = NULL; //保存所有协程
-static wmHash_INT_PTR *user_yield_coros = NULL; //被yield的协程
+
+/**
+ * cid到协程的映射，数组下标就是槽位
+ * cid = 代数 << WM_COROUTINE_SLOT_BITS | 槽位，槽位复用的时候代数加一，旧的cid就找不到了
+ * 空槽位用next_free串起来
+ */
+typedef struct {
+	wmCoroutine *task;
+	uint32_t generation;
+	uint32_t next_free;
+} wmCoroutine_slot;
+
+#define WM_COROUTINE_SLOT_BITS 24
+#define WM_COROUTINE_SLOT_MASK ((1L << WM_COROUTINE_SLOT_BITS) - 1)
+#define WM_COROUTINE_SLOT_NONE UINT32_MAX
+
+/**
+ * 就绪队列，环形数组，先进先出，每个优先级一个
+ * 同时记下cid，出队的时候协程可能已经结束了，槽位被别人用了
+ */
+typedef struct {
+	wmCoroutine *task;
+	long cid;
+} wmCoroutine_ready_item;
+
+typedef struct {
+	wmCoroutine_ready_item *items;
+	uint32_t head;
+	uint32_t num;
+	uint32_t size; //2的幂
+	uint32_t skipped; //队列里有东西，却连着恢复了多少个别的优先级的
+} wmCoroutine_ready_queue;
+
+static wmCoroutine_ready_queue ready_queues[WM_COROUTINE_PRIORITIES];
+static uint32_t ready_num = 0; //所有优先级加起来
+static uint32_t ready_budget = WM_COROUTINE_READY_BUDGET; //loop每一轮最多恢复多少个
+static bool direct_resume = false; //true的话ready直接resume，不进队列
+static bool inherit_context = false; //新协程是否共用创建它的协程的context
+static zval *next_result = NULL; //下一个创建的协程把结果交到哪里
+static int next_priority = -1; //下一个创建的协程的优先级，-1是跟着创建它的协程走
+
+static wmCoroutine_slot *slots = NULL;
+static uint32_t slots_size = 0;
+static uint32_t slots_free = WM_COROUTINE_SLOT_NONE;
 
 static wmCoroutine main_task = { 0 }; //主协程
 static wmCoroutine *current_task = NULL; //当前协程
+static size_t default_stack_size = DEFAULT_C_STACK_SIZE; //没有指定大小的协程用多大的C栈
+
+/**
+ * 用完的wmCoroutine和PHP栈的第一页不释放，放在这两个数组里，下一个协程直接用
+ * 数量有上限，超过了就正常释放
+ */
+static wmCoroutine *task_pool[WM_COROUTINE_POOL_MAX];
+static zend_vm_stack page_pool[WM_COROUTINE_POOL_MAX];
+static wmCoroutine_pool_stats pool_stats = { 0 };
+static uint32_t pool_max = WM_COROUTINE_POOL_MAX; //不能超过WM_COROUTINE_POOL_MAX
+
+/**
+ * 栈剖析的结果，第一次用到某个入口函数的时候才申请
+ */
+static wmCoroutine_stack_profile *stack_profiles[WM_STACK_PROFILE_MAX];
+static int stack_profile_num = 0;
 
 static long run(wmCoroutine *task);
 static void main_func(void *arg);
@@ -17,20 +75,117 @@ static wmCoroutine* get_origin_task(wmCoroutine *task);
 static wmCoroutine* get_task();
 static void restore_vm_stack(wmCoroutine *task);
 static void sleep_callback(void *co);
+static void deadline_callback(void *co);
+static void stack_profile_record(wmCoroutine *task, uint32_t php_used, bool php_overflow);
 
 /**
  * 请求初始化的时候调用
  */
 void wmCoroutine_init() {
-	coroutines = wmHash_init(WM_HASH_INT_STR);
-	user_yield_coros = wmHash_init(WM_HASH_INT_STR);
+	slots = NULL;
+	slots_size = 0;
+	slots_free = WM_COROUTINE_SLOT_NONE;
+}
+
+//扩大槽位数组，新的槽位都挂到空闲链表上
+static bool slots_resize() {
+	uint32_t size = slots_size > 0 ? slots_size * 2 : WM_COROUTINE_SLOTS_INIT;
+	if (size > WM_COROUTINE_SLOT_MASK + 1) {
+		size = WM_COROUTINE_SLOT_MASK + 1;
+	}
+	if (size <= slots_size) {
+		return false;
+	}
+	wmCoroutine_slot *_slots = (wmCoroutine_slot*) wm_realloc(slots, sizeof(wmCoroutine_slot) * size);
+	if (_slots == NULL) {
+		return false;
+	}
+	for (uint32_t i = size; i > slots_size; i--) {
+		_slots[i - 1].task = NULL;
+		_slots[i - 1].generation = 0;
+		_slots[i - 1].next_free = slots_free;
+		slots_free = i - 1;
+	}
+	slots = _slots;
+	slots_size = size;
+	return true;
+}
+
+//给协程分一个槽位，生成cid
+static bool slot_add(wmCoroutine *task) {
+	if (slots_free == WM_COROUTINE_SLOT_NONE && !slots_resize()) {
+		return false;
+	}
+	uint32_t index = slots_free;
+	wmCoroutine_slot *slot = &slots[index];
+	slots_free = slot->next_free;
+	slot->task = task;
+	//代数从1开始，cid不会是0
+	if (++slot->generation == (1U << 31)) {
+		slot->generation = 1;
+	}
+	task->cid = ((long) slot->generation << WM_COROUTINE_SLOT_BITS) | index;
+	return true;
+}
+
+static void slot_del(wmCoroutine *task) {
+	uint32_t index = task->cid & WM_COROUTINE_SLOT_MASK;
+	slots[index].task = NULL;
+	slots[index].next_free = slots_free;
+	slots_free = index;
+}
+
+//池子里有就直接拿，原地清零
+static wmCoroutine* task_alloc() {
+	wmCoroutine *task;
+	if (pool_stats.task_num > 0) {
+		task = task_pool[--pool_stats.task_num];
+		pool_stats.task_hits++;
+	} else {
+		task = (wmCoroutine*) wm_malloc(sizeof(wmCoroutine));
+		pool_stats.task_misses++;
+	}
+	bzero(task, sizeof(wmCoroutine));
+	wmList_init(&task->wait_node);
+	task->wait_fd = -1;
+	return task;
+}
+
+static void task_release(wmCoroutine *task) {
+	if (pool_stats.task_num < pool_max) {
+		task_pool[pool_stats.task_num++] = task;
+		return;
+	}
+	wm_free(task);
 }
 
 /**
  * 创建一个协程
  */
 long wmCoroutine_create(zend_fcall_info_cache *fci_cache, uint32_t argc, zval *argv) {
+	return wmCoroutine_create_ex(fci_cache, argc, argv, 0, false);
+}
+
+/**
+ * 创建一个协程，入口函数的返回值写到result里面
+ * 没接住的异常也放进result，不当成致命错误。result在协程结束之前必须一直有效
+ */
+long wmCoroutine_create_with_result(zend_fcall_info_cache *fci_cache, uint32_t argc, zval *argv, zval *result) {
+	next_result = result;
+	long cid = wmCoroutine_create_ex(fci_cache, argc, argv, 0, false);
+	next_result = NULL;
+	return cid;
+}
+
+/**
+ * 创建一个协程，指定C栈
+ * stack_size是0就用默认大小，hugetlb是用大页，申请不到会退回普通页
+ */
+long wmCoroutine_create_ex(zend_fcall_info_cache *fci_cache, uint32_t argc, zval *argv, size_t stack_size, bool hugetlb) {
 	php_coro_args php_coro_args;
+	//不管创建成不成功都只管这一次
+	int priority = next_priority;
+	next_priority = -1;
 	php_coro_args.fci_cache = fci_cache;
 	php_coro_args.argv = argv;
 	php_coro_args.argc = argc;
@@ -41,18 +196,23 @@ long wmCoroutine_create(zend_fcall_info_cache *fci_cache, uint32_t argc, zval *a
 	}
 
 	//创建协程,注意 这个时候当前的task还没有php协程栈，是在main_func中初始化的
-	wmCoroutine *task = (wmCoroutine*) wm_malloc(sizeof(wmCoroutine));
-	bzero(task, sizeof(wmCoroutine));
-	task->cid = ++last_cid;
-	if (task->cid < 0) {
-		last_cid = 100; //从100开始
-		task->cid = ++last_cid; //创造101
-	}
+	wmCoroutine *task = task_alloc();
 	task->_defer = NULL;
+	task->func = fci_cache->function_handler;
+	task->created = wm_get_now();
+	//马上清掉，协程里面再创建的协程不能拿到
+	task->result = next_result;
+	next_result = NULL;
+	//没指定就跟着创建它的协程，主协程里面创建的是普通优先级
+	if (priority >= 0) {
+		task->priority = priority;
+	} else {
+		task->priority = (current_task && current_task != &main_task) ? current_task->priority : WM_PRIORITY_NORMAL;
+	}
 
-	if (WM_HASH_ADD(WM_HASH_INT_STR, coroutines, task->cid,task) < 0) {
+	if (!slot_add(task)) {
 		wmWarn("wmCoroutine_create-> coroutines_add fail");
-		wm_free(task);
+		task_release(task);
 		return -1;
 	}
 	total_num++; //总数量+1
@@ -61,20 +221,58 @@ long wmCoroutine_create(zend_fcall_info_cache *fci_cache, uint32_t argc, zval *a
 	//也就是把上一个协程堆栈，保存到main_task或者current_task中
 	save_vm_stack(get_task());
 
-	size_t stack_size = DEFAULT_C_STACK_SIZE;
-	wmContext_init(&task->ctx, stack_size, main_func, ((void*) &php_coro_args));
+	stack_size = wmContext_stack_size(stack_size > 0 ? stack_size : default_stack_size, hugetlb);
+	if (!wmContext_init(&task->ctx, stack_size, hugetlb, main_func, ((void*) &php_coro_args))) {
+		wmWarn("wmCoroutine_create-> alloc c stack fail");
+		slot_del(task);
+		total_num--;
+		task_release(task);
+		return -1;
+	}
+
+	//截止时间跟着创建它的协程走
+	if (current_task && current_task != &main_task && current_task->deadline) {
+		wmCoroutine_set_deadline(task, current_task->deadline);
+	}
+	//context是同一个对象，引用+1，谁改了大家都看得到
+	if (inherit_context && current_task && current_task != &main_task && Z_TYPE(current_task->context) == IS_OBJECT) {
+		ZVAL_COPY(&task->context, &current_task->context);
+	}
 
 	return run(task);
 }
 
+/**
+ * from切到to，from的这一段CPU时间记上，to开始计时
+ * 每次切换只读一次时钟
+ */
+static inline void switch_in(wmCoroutine *from, wmCoroutine *to) {
+	uint64_t now = wmGetMonotonicNanoTime();
+	if (from->last_run) {
+		from->cpu_time += now - from->last_run;
+	}
+	to->last_run = now;
+	to->switches++;
+}
+
+//to让出来了（yield或者结束），回到from
+static inline void switch_back(wmCoroutine *to, wmCoroutine *from) {
+	uint64_t now = wmGetMonotonicNanoTime();
+	to->cpu_time += now - to->last_run;
+	from->last_run = now;
+}
+
 long run(wmCoroutine *task) {
 	long cid = task->cid;
 	//唤起协程 = 记录的上一个协程
 	task->origin = current_task;
 	current_task = task;
+	wmCoroutine *from = get_origin_task(task);
 
 	//切换到这个堆栈来工作,在这里面切换了C栈，并且在回调中申请了php协程栈
+	switch_in(from, task);
 	wmContext_swap_in(&task->ctx);
+	switch_back(task, from);
 	//下面有可能执行完毕，也有可能程序自己yield了
 
 	//判断一下是否执行完毕了
@@ -186,6 +384,18 @@ void main_func(void *arg) {
 		zend_vm_stack_free_args(call);
 	}
 
+	//有人要结果，返回值交出去，异常也交出去，不再往上抛
+	if (_task->result) {
+		if (UNEXPECTED(EG(exception))) {
+			GC_ADDREF(EG(exception));
+			ZVAL_OBJ(_task->result, EG(exception));
+			zend_clear_exception();
+		} else {
+			ZVAL_COPY_VALUE(_task->result, retval);
+			ZVAL_UNDEF(retval);
+		}
+	}
+
 	wmStack *defer_tasks = _task->defer_tasks;
 
 	if (defer_tasks) {
@@ -212,6 +422,12 @@ void main_func(void *arg) {
 		_task->_defer(_task->_defer_data);
 	}
 
+	//context在defer之后释放，defer里面还能用。这时候还在协程里面，里面对象的析构函数可以正常跑
+	if (Z_TYPE(_task->context) != IS_UNDEF) {
+		zval_ptr_dtor(&_task->context);
+		ZVAL_UNDEF(&_task->context);
+	}
+
 	//释放
 	zval_ptr_dtor(retval);
 
@@ -250,7 +466,15 @@ wmCoroutine* get_task() {
  */
 void vm_stack_init() {
 	uint32_t size = DEFAULT_PHP_STACK_PAGE_SIZE;
-	zend_vm_stack page = (zend_vm_stack) emalloc(size);
+	zend_vm_stack page;
+	//上一个协程留下来的第一页，直接拿来用，下面会重新设置top和end
+	if (pool_stats.page_num > 0) {
+		page = page_pool[--pool_stats.page_num];
+		pool_stats.page_hits++;
+	} else {
+		page = (zend_vm_stack) emalloc(size);
+		pool_stats.page_misses++;
+	}
 
 	//page->top的作用是指向目前的栈顶，这个top会随着栈里面的数据而不断的变化。压栈，top往靠近end的方向移动个；出栈，top往远离end的方向移动。
 	page->top = ZEND_VM_STACK_ELEMENTS(page);
@@ -266,6 +490,13 @@ void vm_stack_init() {
 #if PHP_VERSION_ID >= 70300
 	EG(vm_stack_page_size) = size;
 #endif
+	//C栈刷了canary的话，PHP栈第一页也刷上，destroy的时候一起量
+	if (current_task && current_task->ctx.profiled_) {
+		uint64_t *p = (uint64_t*) EG(vm_stack_top);
+		while (p < (uint64_t*) EG(vm_stack_end)) {
+			*p++ = WM_STACK_CANARY;
+		}
+	}
 }
 
 /**
@@ -287,11 +518,9 @@ void save_vm_stack(wmCoroutine *task) {
 void wmCoroutine_yield() {
 	wmCoroutine *task = wmCoroutine_get_current();
 	assert(current_task == task); //是否具备切换资格
-	//放入协程切换队列
-	if (WM_HASH_ADD(WM_HASH_INT_STR, user_yield_coros, task->cid, task) < 0) {
-		wmWarn("wmCoroutine_yield-> user_yield_coros_add fail");
-		return;
-	}
+	//标记一下，只有yield过的才能被resume
+	task->yielded = true;
+	task->yield_at = wm_get_now();
 
 	wmCoroutine *origin_task = task->origin;
 
@@ -304,6 +533,67 @@ void wmCoroutine_yield() {
 	wmContext_swap_out(&task->ctx);
 }
 
+/**
+ * 在可以取消的地方yield，醒来之后调用的地方自己收拾等待的东西
+ * 已经被取消了就不yield，返回false
+ */
+bool wmCoroutine_yield_cancelable() {
+	wmCoroutine *task = wmCoroutine_get_current();
+	if (task->cancelled) {
+		task->wait_type = WM_WAIT_NONE;
+		task->wait_fd = -1;
+		return false;
+	}
+	task->cancelable = true;
+	wmCoroutine_yield();
+	task->cancelable = false;
+	return !task->cancelled;
+}
+
+/**
+ * 取消一个协程，code是错误码
+ * 正卡在可以取消的地方就放进就绪队列唤醒，没卡着的话下一次卡住的时候直接返回
+ */
+bool wmCoroutine_cancel(wmCoroutine *task, int code) {
+	if (task == NULL || task == &main_task) {
+		return false;
+	}
+	if (task->cancelled) {
+		return true;
+	}
+	task->cancelled = code;
+	if (task->yielded && task->cancelable) {
+		wmCoroutine_ready(task);
+	}
+	return true;
+}
+
+/**
+ * 设置截止时间，单调时钟的微秒，0是取消截止时间
+ * 到点了按WM_ERROR_COROUTINE_DEADLINE取消，主协程取消不了，所以也不能设
+ */
+bool wmCoroutine_set_deadline(wmCoroutine *task, uint64_t deadline) {
+	if (task == NULL || task == &main_task) {
+		return false;
+	}
+	if (task->deadline_timer) {
+		wmTimerWheel_del(&WorkerG.timer, task->deadline_timer);
+		task->deadline_timer = NULL;
+	}
+	task->deadline = deadline;
+	if (deadline == 0) {
+		return true;
+	}
+	uint64_t now = wm_get_now();
+	if (deadline <= now) {
+		wmCoroutine_cancel(task, WM_ERROR_COROUTINE_DEADLINE);
+		return true;
+	}
+	uint64_t ticks = (deadline - now + 999) / 1000;
+	task->deadline_timer = wmTimerWheel_add_quick(&WorkerG.timer, deadline_callback, (void*) task, ticks > UINT32_MAX ? UINT32_MAX : ticks);
+	return true;
+}
+
 /**
  * 恢复协程
  */
@@ -311,11 +601,14 @@ bool wmCoroutine_resume(wmCoroutine *task) {
 	assert(current_task != task);
 
 	//判断是否之前yield过
-	wmCoroutine *yield_co = WM_HASH_GET(WM_HASH_INT_STR, user_yield_coros, task->cid);
-	if (yield_co == NULL) {
+	if (!task->yielded) {
 		return false;
 	}
-	WM_HASH_DEL(WM_HASH_INT_STR, user_yield_coros, task->cid);
+	task->yielded = false;
+	//在就绪队列里面的话，那边出队的时候跳过
+	task->ready = false;
+	task->wait_type = WM_WAIT_NONE;
+	task->wait_fd = -1;
 
 	wmCoroutine *_current_task = get_task();
 	//这里要注意，不是保存的父协程，是谁唤醒他的，就保存谁保存当前的协程
@@ -326,7 +619,9 @@ bool wmCoroutine_resume(wmCoroutine *task) {
 	task->origin = current_task;
 	current_task = task;
 
+	switch_in(_current_task, task);
 	wmContext_swap_in(&task->ctx);
+	switch_back(task, _current_task);
 	if (task->ctx.end_) {
 		//如果不相等，说明已经创建了其他的协程
 		assert(current_task == task);
@@ -338,24 +633,187 @@ bool wmCoroutine_resume(wmCoroutine *task) {
 	return true;
 }
 
+/**
+ * 把一个yield的协程标记成就绪，放进它那个优先级的队列，loop每一轮处理完事件之后恢复
+ * 在协程里面唤醒别的协程用这个，不会一层套一层的resume
+ * loop没跑或者开了direct_resume，还是直接resume
+ */
+void wmCoroutine_ready(wmCoroutine *task) {
+	if (direct_resume || !WorkerG.is_running) {
+		wmCoroutine_resume(task);
+		return;
+	}
+	if (!task->yielded || task->ready) {
+		return;
+	}
+	wmCoroutine_ready_queue *q = &ready_queues[task->priority];
+	if (q->num == q->size) {
+		uint32_t size = q->size > 0 ? q->size * 2 : WM_COROUTINE_READY_QUEUE_INIT;
+		wmCoroutine_ready_item *items = (wmCoroutine_ready_item*) wm_malloc(sizeof(wmCoroutine_ready_item) * size);
+		if (items == NULL) {
+			wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
+			wmCoroutine_resume(task);
+			return;
+		}
+		//按顺序搬到新数组的开头
+		for (uint32_t i = 0; i < q->num; i++) {
+			items[i] = q->items[(q->head + i) & (q->size - 1)];
+		}
+		if (q->items) {
+			wm_free(q->items);
+		}
+		q->items = items;
+		q->head = 0;
+		q->size = size;
+	}
+	wmCoroutine_ready_item *item = &q->items[(q->head + q->num) & (q->size - 1)];
+	item->task = task;
+	item->cid = task->cid;
+	q->num++;
+	ready_num++;
+	task->ready = true;
+}
+
+bool wmCoroutine_has_ready() {
+	return ready_num > 0;
+}
+
+/**
+ * 下一个从哪个优先级的队列出
+ * 平时高的先出，低的队列连着被跳过WM_COROUTINE_STARVE_LIMIT次就轮它一次，不会饿死
+ * 饿着的不止一个，先给饿得久的
+ */
+static wmCoroutine_ready_queue* ready_pick() {
+	wmCoroutine_ready_queue *pick = NULL;
+	wmCoroutine_ready_queue *starved = NULL;
+	for (int i = 0; i < WM_COROUTINE_PRIORITIES; i++) {
+		wmCoroutine_ready_queue *q = &ready_queues[i];
+		if (q->num == 0) {
+			continue;
+		}
+		if (pick == NULL) {
+			pick = q;
+		}
+		if (q->skipped >= WM_COROUTINE_STARVE_LIMIT && (starved == NULL || q->skipped > starved->skipped)) {
+			starved = q;
+		}
+	}
+	return starved ? starved : pick;
+}
+
+/**
+ * 恢复就绪队列里面的协程，最多ready_budget个，剩下的留给下一轮
+ * 返回队列里还有没有
+ */
+bool wmCoroutine_run_ready() {
+	uint32_t n = 0;
+	while (ready_num > 0 && n < ready_budget) {
+		wmCoroutine_ready_queue *q = ready_pick();
+		wmCoroutine_ready_item item = q->items[q->head];
+		q->head = (q->head + 1) & (q->size - 1);
+		q->num--;
+		ready_num--;
+		//已经被别人直接resume过了，或者协程已经没了，或者改了优先级挪到别的队列去了
+		if (wmCoroutine_get_by_cid(item.cid) != item.task || !item.task->ready || &ready_queues[item.task->priority] != q) {
+			continue;
+		}
+		n++;
+		//别的队列里有在等的，都记一次被跳过
+		q->skipped = 0;
+		for (int i = 0; i < WM_COROUTINE_PRIORITIES; i++) {
+			if (&ready_queues[i] != q && ready_queues[i].num > 0) {
+				ready_queues[i].skipped++;
+			}
+		}
+		wmCoroutine_resume(item.task);
+	}
+	return ready_num > 0;
+}
+
+/**
+ * 改协程的优先级，已经在就绪队列里面的挪到新的队列后面去
+ */
+void wmCoroutine_set_priority(wmCoroutine *task, int priority) {
+	if (task->priority == priority) {
+		return;
+	}
+	task->priority = priority;
+	if (task->ready && WorkerG.is_running && !direct_resume) {
+		//旧队列里的那一项出队的时候对不上优先级，会被跳过
+		task->ready = false;
+		wmCoroutine_ready(task);
+	}
+}
+
+/**
+ * 下一个创建的协程用这个优先级，创建完就失效
+ */
+void wmCoroutine_set_next_priority(int priority) {
+	next_priority = priority;
+}
+
+const char* wmCoroutine_get_priority_name(int priority) {
+	switch (priority) {
+	case WM_PRIORITY_HIGH:
+		return "high";
+	case WM_PRIORITY_LOW:
+		return "low";
+	default:
+		return "normal";
+	}
+}
+
+void wmCoroutine_set_ready_budget(uint32_t budget) {
+	ready_budget = budget > 0 ? budget : WM_COROUTINE_READY_BUDGET;
+}
+
+void wmCoroutine_set_direct_resume(bool direct) {
+	direct_resume = direct;
+}
+
+void wmCoroutine_set_inherit_context(bool inherit) {
+	inherit_context = inherit;
+}
+
+bool wmCoroutine_get_inherit_context() {
+	return inherit_context;
+}
+
+/**
+ * 协程本地存储，第一次用的时候创建一个ArrayObject
+ * 协程跑完的时候跟着释放，不用自己在defer里面清理
+ */
+zval* wmCoroutine_get_context(wmCoroutine *task) {
+	if (Z_TYPE(task->context) == IS_UNDEF) {
+		object_init_ex(&task->context, spl_ce_ArrayObject);
+	}
+	return &task->context;
+}
+
 void close_coro(wmCoroutine *task) {
-	//在hash表中删除
-	WM_HASH_DEL(WM_HASH_INT_STR, coroutines, task->cid);
+	//释放槽位，这个cid以后就找不到了
+	slot_del(task);
+	if (task->deadline_timer) {
+		wmTimerWheel_del(&WorkerG.timer, task->deadline_timer);
+		task->deadline_timer = NULL;
+	}
 	total_num--; //总数量-1
 
-	//yield表中删除
-	WM_HASH_DEL(WM_HASH_INT_STR, user_yield_coros, task->cid);
-
 	//获取他的唤起
 	wmCoroutine *origin_task = get_origin_task(task);
 	//销毁ctx
 	wmContext_destroy(&task->ctx);
 
-	vm_stack_destroy();
+	vm_stack_destroy(task);
 	restore_vm_stack(origin_task);
 
-	//销毁自己
-	wm_free(task);
+	//main_func里面已经释放过了，这里是防着析构函数里面又调了getContext
+	if (Z_TYPE(task->context) != IS_UNDEF) {
+		zval_ptr_dtor(&task->context);
+	}
+
+	//销毁自己，放回池子
+	task_release(task);
 	task = NULL;
 }
 
@@ -377,10 +835,31 @@ void restore_vm_stack(wmCoroutine *task) {
 }
 
 //清空整个php允许栈，我们不需要保存，都在自己task内保存
-void vm_stack_destroy() {
+//最底下那一页是vm_stack_init申请的，池子没满就留着，后面PHP自己扩出来的页直接释放
+void vm_stack_destroy(wmCoroutine *task) {
 	zend_vm_stack stack = EG(vm_stack);
+	if (task->ctx.profiled_) {
+		zend_vm_stack first = stack;
+		while (first->prev != NULL) {
+			first = first->prev;
+		}
+		//PHP栈是往上长的，从end往下找第一个被改过的地方
+		uint64_t *begin = (uint64_t*) (ZEND_VM_STACK_ELEMENTS(first) + 1);
+		uint64_t *p = (uint64_t*) first->end;
+		while (p > begin && *(p - 1) == WM_STACK_CANARY) {
+			p--;
+		}
+		//扩页的时候PHP会把当时的栈顶存到旧页的top上，vm_stack_init之后top就不会再动了
+		bool overflow = first != stack || first->top != ZEND_VM_STACK_ELEMENTS(first) + 1;
+		stack_profile_record(task, (uint32_t) ((char*) p - (char*) ZEND_VM_STACK_ELEMENTS(first)), overflow);
+	}
 	while (stack != NULL) {
 		zend_vm_stack p = stack->prev;
+		if (p == NULL && pool_stats.page_num < pool_max
+			&& (char*) stack->end - (char*) stack == DEFAULT_PHP_STACK_PAGE_SIZE) {
+			page_pool[pool_stats.page_num++] = stack;
+			break;
+		}
 		//内存叶读取出问题，好像重复释放了
 		efree(stack);
 		stack = p;
@@ -403,31 +882,337 @@ wmCoroutine* wmCoroutine_get_current() {
  * 通过ID获取协程
  */
 wmCoroutine* wmCoroutine_get_by_cid(long _cid) {
-	return WM_HASH_GET(WM_HASH_INT_STR, coroutines, _cid);
+	if (_cid <= 0) {
+		return NULL;
+	}
+	uint32_t index = _cid & WM_COROUTINE_SLOT_MASK;
+	if (index >= slots_size || slots[index].task == NULL) {
+		return NULL;
+	}
+	//槽位已经给别的协程用了
+	if (slots[index].generation != (uint32_t) (_cid >> WM_COROUTINE_SLOT_BITS)) {
+		return NULL;
+	}
+	return slots[index].task;
 }
 
 /**
  * 释放申请相关内存
  */
 void wmCoroutine_shutdown() {
-	wmHash_destroy(WM_HASH_INT_STR, coroutines);
-	wmHash_destroy(WM_HASH_INT_STR, user_yield_coros);
+	if (slots) {
+		wm_free(slots);
+		slots = NULL;
+	}
+	for (int i = 0; i < WM_COROUTINE_PRIORITIES; i++) {
+		if (ready_queues[i].items) {
+			wm_free(ready_queues[i].items);
+		}
+	}
+	memset(ready_queues, 0, sizeof(ready_queues));
+	ready_num = 0;
+	slots_size = 0;
+	slots_free = WM_COROUTINE_SLOT_NONE;
+	wmContext_pool_clear();
+	wmCoroutine_reset_stack_profiles();
+	//PHP栈的页是emalloc的，请求结束之前必须还回去
+	wmCoroutine_set_pool_max(0);
+	pool_max = WM_COROUTINE_POOL_MAX;
+}
+
+/**
+ * 设置wmCoroutine和PHP栈页最多缓存几个，多出来的马上释放
+ */
+void wmCoroutine_set_pool_max(uint32_t max) {
+	pool_max = max < WM_COROUTINE_POOL_MAX ? max : WM_COROUTINE_POOL_MAX;
+	while (pool_stats.page_num > pool_max) {
+		efree(page_pool[--pool_stats.page_num]);
+	}
+	while (pool_stats.task_num > pool_max) {
+		wm_free(task_pool[--pool_stats.task_num]);
+	}
+}
+
+/**
+ * 协程一共跑了多少纳秒，正在跑的要加上这一段
+ */
+uint64_t wmCoroutine_get_cpu_time(wmCoroutine *task) {
+	if (task == current_task) {
+		return task->cpu_time + (wmGetMonotonicNanoTime() - task->last_run);
+	}
+	return task->cpu_time;
+}
+
+/**
+ * 找出CPU时间最多的n个协程，按从多到少放进list，返回找到几个
+ */
+int wmCoroutine_top(wmCoroutine **list, int n) {
+	int num = 0;
+	for (uint32_t i = 0; i < slots_size; i++) {
+		wmCoroutine *task = slots[i].task;
+		if (task == NULL) {
+			continue;
+		}
+		uint64_t cpu_time = wmCoroutine_get_cpu_time(task);
+		//插入排序，n一般很小
+		int j = num < n ? num++ : n;
+		while (j > 0 && wmCoroutine_get_cpu_time(list[j - 1]) < cpu_time) {
+			if (j < n) {
+				list[j] = list[j - 1];
+			}
+			j--;
+		}
+		if (j < n) {
+			list[j] = task;
+		}
+	}
+	return num;
+}
+
+/**
+ * 入口函数的名字，类::方法，闭包带上文件和行号
+ */
+int wmCoroutine_get_name(wmCoroutine *task, char *buf, size_t size) {
+	zend_function *func = task->func;
+	if (func == NULL || func->common.function_name == NULL) {
+		return wm_snprintf(buf, size, "{main}");
+	}
+	if (func->type == ZEND_USER_FUNCTION && (func->common.fn_flags & ZEND_ACC_CLOSURE)) {
+		return wm_snprintf(buf, size, "{closure}@%s:%u", ZSTR_VAL(func->op_array.filename), func->op_array.line_start);
+	}
+	if (func->common.scope) {
+		return wm_snprintf(buf, size, "%s::%s", ZSTR_VAL(func->common.scope->name), ZSTR_VAL(func->common.function_name));
+	}
+	return wm_snprintf(buf, size, "%s", ZSTR_VAL(func->common.function_name));
+}
+
+/**
+ * 协程结束的时候记一笔，C栈在wmContext_destroy里面已经量好了
+ */
+static void stack_profile_record(wmCoroutine *task, uint32_t php_used, bool php_overflow) {
+	char name[sizeof(((wmCoroutine_stack_profile*) NULL)->name)];
+	wmCoroutine_stack_profile *profile = NULL;
+	wmCoroutine_get_name(task, name, sizeof(name));
+	for (int i = 0; i < stack_profile_num; i++) {
+		if (strcmp(stack_profiles[i]->name, name) == 0) {
+			profile = stack_profiles[i];
+			break;
+		}
+	}
+	if (profile == NULL) {
+		//最后一个位置留给{other}，真正的入口函数最多WM_STACK_PROFILE_MAX-1个
+		if (stack_profile_num == WM_STACK_PROFILE_MAX) {
+			profile = stack_profiles[WM_STACK_PROFILE_MAX - 1];
+		} else {
+			profile = (wmCoroutine_stack_profile*) wm_malloc(sizeof(wmCoroutine_stack_profile));
+			bzero(profile, sizeof(wmCoroutine_stack_profile));
+			wm_snprintf(profile->name, sizeof(profile->name), "%s", stack_profile_num == WM_STACK_PROFILE_MAX - 1 ? "{other}" : name);
+			stack_profiles[stack_profile_num++] = profile;
+		}
+	}
+	wmHistogram_record(&profile->c_stack, task->ctx.stack_used_);
+	wmHistogram_record(&profile->php_stack, php_used);
+	if (php_overflow) {
+		profile->php_overflows++;
+	}
+	profile->c_stack_size = task->ctx.stack_size_;
+}
+
+/**
+ * 记下当前协程接下来要yield等什么，在yield之前调用
+ */
+void wmCoroutine_set_wait(int type, int fd) {
+	if (current_task == NULL) {
+		return;
+	}
+	current_task->wait_type = type;
+	current_task->wait_fd = fd;
+}
+
+/**
+ * running是正在跑的，suspended是唤起了别的协程、等它让出来的
+ */
+const char* wmCoroutine_get_state(wmCoroutine *task) {
+	if (task == current_task) {
+		return "running";
+	}
+	if (task->ready) {
+		return "ready";
+	}
+	if (task->yielded) {
+		return "yielded";
+	}
+	return "suspended";
+}
+
+const char* wmCoroutine_get_wait_name(wmCoroutine *task) {
+	if (!task->yielded) {
+		return "";
+	}
+	switch (task->wait_type) {
+	case WM_WAIT_READ:
+		return "read";
+	case WM_WAIT_WRITE:
+		return "write";
+	case WM_WAIT_CHANNEL:
+		return "channel";
+	case WM_WAIT_SLEEP:
+		return "sleep";
+	case WM_WAIT_SYNC:
+		return "sync";
+	case WM_WAIT_PAUSED:
+		return "paused";
+	case WM_WAIT_ACCEPT:
+		return "accept";
+	default:
+		return "yield";
+	}
+}
+
+/**
+ * 按槽位顺序列出所有协程，最多n个，返回找到几个
+ */
+int wmCoroutine_list(wmCoroutine **list, int n) {
+	int num = 0;
+	for (uint32_t i = 0; i < slots_size && num < n; i++) {
+		if (slots[i].task) {
+			list[num++] = slots[i].task;
+		}
+	}
+	return num;
+}
+
+/**
+ * 协程现在执行到哪里了，正在跑的协程存的是上一次切出去的时候的，要用EG里面的
+ */
+zend_execute_data* wmCoroutine_get_execute_data(wmCoroutine *task) {
+	if (task == current_task) {
+		return EG(current_execute_data);
+	}
+	return task->execute_data;
+}
+
+/**
+ * 一层调用栈，函数名加上执行到的文件和行号
+ */
+int wmCoroutine_get_frame(zend_execute_data *ex, char *buf, size_t size) {
+	zend_function *func = ex->func;
+	const char *scope = "";
+	const char *sep = "";
+	const char *name = "{main}";
+	if (func->common.function_name) {
+		name = ZSTR_VAL(func->common.function_name);
+		if (func->common.scope) {
+			scope = ZSTR_VAL(func->common.scope->name);
+			sep = "::";
+		}
+	}
+	if (func->type == ZEND_USER_FUNCTION && ex->opline) {
+		return wm_snprintf(buf, size, "%s%s%s() %s:%u", scope, sep, name, ZSTR_VAL(func->op_array.filename), ex->opline->lineno);
+	}
+	return wm_snprintf(buf, size, "%s%s%s()", scope, sep, name);
+}
+
+/**
+ * 把所有协程的状态和调用栈写到out后面，给coroutines命令用
+ * 一个进程卡住了，看看几百个协程都卡在哪里
+ */
+void wmCoroutine_dump(wmString *out) {
+	char line[512];
+	char name[128];
+	char frame[384];
+	int len;
+	uint64_t now = wm_get_now();
+	for (uint32_t i = 0; i < slots_size; i++) {
+		wmCoroutine *task = slots[i].task;
+		if (task == NULL) {
+			continue;
+		}
+		wmCoroutine_get_name(task, name, sizeof(name));
+		len = wm_snprintf(line, sizeof(line), "  cid:%ld %s %s", task->cid, wmCoroutine_get_state(task), wmCoroutine_get_wait_name(task));
+		if (task->yielded && task->wait_fd >= 0) {
+			len += wm_snprintf(line + len, sizeof(line) - len, " fd:%d", task->wait_fd);
+		}
+		if (task->yielded) {
+			len += wm_snprintf(line + len, sizeof(line) - len, " for:%.3fs", (double) (now - task->yield_at) / 1000000);
+		}
+		if (task->priority != WM_PRIORITY_NORMAL) {
+			len += wm_snprintf(line + len, sizeof(line) - len, " priority:%s", wmCoroutine_get_priority_name(task->priority));
+		}
+		len += wm_snprintf(line + len, sizeof(line) - len, " %s\n", name);
+		wmString_append_ptr(out, line, len);
+
+		zend_execute_data *ex = wmCoroutine_get_execute_data(task);
+		for (int depth = 0; ex && depth < WM_COROUTINE_DUMP_FRAMES; ex = ex->prev_execute_data) {
+			if (ex->func == NULL) {
+				continue;
+			}
+			wmCoroutine_get_frame(ex, frame, sizeof(frame));
+			len = wm_snprintf(line, sizeof(line), "      #%d %s\n", depth++, frame);
+			wmString_append_ptr(out, line, len);
+		}
+	}
+}
+
+/**
+ * 栈剖析的结果，返回有几个入口函数
+ */
+int wmCoroutine_get_stack_profiles(wmCoroutine_stack_profile ***list) {
+	*list = stack_profiles;
+	return stack_profile_num;
+}
+
+void wmCoroutine_reset_stack_profiles() {
+	for (int i = 0; i < stack_profile_num; i++) {
+		wm_free(stack_profiles[i]);
+		stack_profiles[i] = NULL;
+	}
+	stack_profile_num = 0;
+}
+
+wmCoroutine_pool_stats* wmCoroutine_get_pool_stats() {
+	return &pool_stats;
+}
+
+/**
+ * 设置默认的C栈大小，已经创建的协程不受影响
+ */
+void wmCoroutine_set_stack_size(size_t stack_size) {
+	default_stack_size = stack_size > 0 ? stack_size : DEFAULT_C_STACK_SIZE;
+}
+
+size_t wmCoroutine_get_stack_size() {
+	return default_stack_size;
 }
 
 int wmCoroutine_getTotalNum() {
 	return total_num;
 }
 
-void wmCoroutine_sleep(double seconds) {
+bool wmCoroutine_sleep(double seconds) {
 	if (seconds < 0.001) {
 		seconds = 0.001;
 	}
 	wmCoroutine *co = wmCoroutine_get_current();
-	wmTimerWheel_add_quick(&WorkerG.timer, sleep_callback, (void*) co, seconds * 1000);
-	wmCoroutine_yield();
+	co->wait_timer = wmTimerWheel_add_quick(&WorkerG.timer, sleep_callback, (void*) co, seconds * 1000);
+	wmCoroutine_set_wait(WM_WAIT_SLEEP, -1);
+	bool ret = wmCoroutine_yield_cancelable();
+	//被取消提前醒来的，定时器还在
+	if (co->wait_timer) {
+		wmTimerWheel_del(&WorkerG.timer, co->wait_timer);
+		co->wait_timer = NULL;
+	}
+	return ret;
 }
 
 //sleep回调
 void sleep_callback(void *co) {
+	((wmCoroutine*) co)->wait_timer = NULL;
 	wmCoroutine_resume((wmCoroutine*) co);
 }
+
+//截止时间到了
+void deadline_callback(void *co) {
+	((wmCoroutine*) co)->deadline_timer = NULL;
+	wmCoroutine_cancel((wmCoroutine*) co, WM_ERROR_COROUTINE_DEADLINE);
+}
@@ -145,12 +145,12 @@ void timer_add(wmSocket *socket, int event, uint32_t ticks) {
 void timer_del(wmSocket *socket, int event) {
 	if (event == WM_EVENT_READ) {
 		if (socket->read_timer) { //如果没使用相应定时器，那么删除
-			wmTimerWheel_del(socket->read_timer); //没触发超时的话，删除定时器节点
+			wmTimerWheel_del(&WorkerG.timer, socket->read_timer); //没触发超时的话，删除定时器节点
 			socket->read_timer = NULL;
 		}
 	} else if (event & WM_EVENT_WRITE) {
 		if (socket->write_timer) { //如果没使用相应定时器，那么删除
-			wmTimerWheel_del(socket->write_timer); //没触发超时的话，删除定时器节点
+			wmTimerWheel_del(&WorkerG.timer, socket->write_timer); //没触发超时的话，删除定时器节点
 			socket->write_timer = NULL;
 		}
 	} else {
@@ -226,6 +226,9 @@ wmSocket* wmSocket_pack(int fd, int transport, int loop_type) {
 
 	socket->onBufferWillFull = NULL;
 	socket->events = WM_EVENT_NULL;
+	socket->poll_events = WM_EVENT_NULL;
+	socket->pending = -1;
+	socket->ready = WM_EVENT_NULL;
 	socket->errCode = 0; //默认没有错误
 	socket->errMsg = NULL;
 	socket->shutdown_read = false;
@@ -302,6 +305,7 @@ bool wmSocket_connect(wmSocket *socket, char *_host, int _port, uint32_t timeout
 			timer_add(socket, WM_EVENT_WRITE, timeout);
 			if (!event_wait(socket, WM_EVENT_WRITE) || timer_used(socket, WM_EVENT_WRITE)) {
 				set_err(socket, errno);
+				timer_del(socket, WM_EVENT_WRITE);
 				return false;
 			}
 
@@ -434,6 +438,34 @@ int wmSocket_read(wmSocket *socket, char *buf, int len, uint32_t timeout) {
 	return WM_SOCKET_CLOSE;
 }
 
+/**
+ * 不等待的读，读不到数据直接返回WM_SOCKET_SUCCESS
+ * 给WM_LOOP_CALLBACK用，可读的时候才会调用，不用挂协程等事件
+ */
+int wmSocket_read_nowait(wmSocket *socket, char *buf, int len) {
+	if (!is_available(socket, WM_EVENT_READ)) {
+		return WM_SOCKET_CLOSE;
+	}
+	int ret;
+	do {
+		ret = wm_socket_recv(socket->fd, buf, len, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret > 0) {
+		return ret;
+	}
+	if (ret == 0) {
+		socket->closed = true;
+		set_err(socket, WM_ERROR_SESSION_CLOSED_BY_CLIENT);
+		return WM_SOCKET_CLOSE;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		return WM_SOCKET_SUCCESS;
+	}
+	set_err(socket, errno);
+	return WM_SOCKET_ERROR;
+}
+
 /**
  * 所有写入都是协程同步的
  */
@@ -480,7 +512,12 @@ int wmSocket_send(wmSocket *socket, const void *buf, size_t len) {
 			socket->write_buffer->length = 0;
 			return ret_num;
 		}
-		event_wait(socket, WM_EVENT_WRITE);
+		//被取消了，没发完的留在缓冲区里
+		if (!event_wait(socket, WM_EVENT_WRITE)) {
+			set_err(socket, errno);
+			wmWorkerLoop_remove(socket, WM_EVENT_WRITE);
+			return WM_SOCKET_ERROR;
+		}
 	}
 	wmWorkerLoop_remove(socket, WM_EVENT_WRITE);
 	set_err(socket, WM_ERROR_SESSION_CLOSED);
@@ -515,7 +552,11 @@ int wmSocket_write(wmSocket *socket, const void *buf, size_t len) {
 			wmWorkerLoop_remove(socket, WM_EVENT_WRITE);
 			return ret_num;
 		}
-		event_wait(socket, WM_EVENT_WRITE);
+		if (!event_wait(socket, WM_EVENT_WRITE)) {
+			set_err(socket, errno);
+			wmWorkerLoop_remove(socket, WM_EVENT_WRITE);
+			return WM_SOCKET_ERROR;
+		}
 	}
 	set_err(socket, WM_ERROR_SESSION_CLOSED);
 	return WM_SOCKET_CLOSE;
@@ -523,6 +564,7 @@ int wmSocket_write(wmSocket *socket, const void *buf, size_t len) {
 
 /**
  * 不同的loop_type操作是不同的
+ * 协程被取消或者到了截止时间返回false
  */
 bool event_wait(wmSocket *socket, int event) {
 	//如果没有事件监听,就加上
@@ -531,13 +573,23 @@ bool event_wait(wmSocket *socket, int event) {
 			return false;
 		}
 	}
+	//边缘触发的时候，已经通知过就绪了，直接回去再试一次，不用yield
+	if (socket->loop_type == WM_LOOP_EDGE && (socket->ready & event)) {
+		socket->ready &= (~event);
+		return true;
+	}
 	if (event & WM_EVENT_READ) {
 		socket->read_co = wmCoroutine_get_current();
 	}
 	if (event & WM_EVENT_WRITE) {
 		socket->write_co = wmCoroutine_get_current();
 	}
-	wmCoroutine_yield();
+	WorkerG.poll->wait_num++;
+	wmCoroutine_set_wait((event & WM_EVENT_READ) ? WM_WAIT_READ : WM_WAIT_WRITE, socket->fd);
+	bool ret = wmCoroutine_yield_cancelable();
+	if (WorkerG.poll) {
+		WorkerG.poll->wait_num--;
+	}
 
 	//下面删除对应的co
 	if (event & WM_EVENT_READ) {
@@ -547,6 +599,13 @@ bool event_wait(wmSocket *socket, int event) {
 		socket->write_co = NULL;
 	}
 
+	//协程被取消了，errno是取消的错误码
+	//监听也要去掉，不然下次就绪的时候loop看到没有协程在等，会把socket关掉。边缘触发的remove里面会跳过
+	if (!ret) {
+		wmWorkerLoop_remove(socket, event);
+		errno = wmCoroutine_get_current()->cancelled;
+		return false;
+	}
 	return true;
 }
 
@@ -604,9 +663,9 @@ bool wmSocket_shutdown(wmSocket *socket, int __how) {
  */
 int wmSocket_close(wmSocket *socket) {
 	socket->closed = true;
-	if (socket->events != WM_EVENT_NULL) {
-		//socket->events = WM_EVENT_NULL;
-		wmWorkerLoop_del(socket); //释放事件
+	if (socket->events != WM_EVENT_NULL || socket->poll_events != WM_EVENT_NULL || socket->pending >= 0) {
+		//fd马上就要关掉了，不能等到下一轮再删除
+		wmWorkerLoop_detach(socket); //释放事件
 		if (socket->read_co) {
 			wmCoroutine_resume(socket->read_co);
 		}
@@ -639,10 +698,10 @@ void wmSocket_free(wmSocket *socket) {
 		wmString_free(socket->remoteIp);
 	}
 	if (socket->read_timer) {
-		wmTimerWheel_del(socket->read_timer);
+		wmTimerWheel_del(&WorkerG.timer, socket->read_timer);
 	}
 	if (socket->write_timer) {
-		wmTimerWheel_del(socket->write_timer);
+		wmTimerWheel_del(&WorkerG.timer, socket->write_timer);
 	}
 	if (socket->udp_addr) {
 		wm_free(socket->udp_addr);
@@ -0,0 +1,235 @@
+#include "sync.h"
+#include "coroutine.h"
+
+static void sync_timeout(void *param);
+
+#define sync_waiter(node) ((wmCoroutine*) ((char*) (node) - offsetof(wmCoroutine, wait_node)))
+
+/**
+ * 当前协程挂到waiters后面等，被唤醒返回true，超时或者被取消返回false
+ * 唤醒的一方要先把状态改好（锁交给谁、许可给谁），再把协程从链表上摘下来放进就绪队列
+ */
+static bool sync_wait(wmListNode *waiters, double timeout) {
+	wmCoroutine *co = wmCoroutine_get_current();
+	if (co == NULL) {
+		wmWarn("must be called in a coroutine");
+		return false;
+	}
+	co->wait_timeout = false;
+	co->wait_timer = NULL;
+	if (timeout > 0) {
+		co->wait_timer = wmTimerWheel_add_quick(&WorkerG.timer, sync_timeout, (void*) co, timeout * 1000);
+	}
+	wmList_add_back(waiters, &co->wait_node);
+	wmCoroutine_set_wait(WM_WAIT_SYNC, -1);
+	wmCoroutine_yield_cancelable();
+	if (co->wait_timer) {
+		wmTimerWheel_del(&WorkerG.timer, co->wait_timer);
+		co->wait_timer = NULL;
+	}
+	//还挂在链表上，说明是被取消醒来的，没等到
+	//已经被摘下来的话，东西已经交到手上了，就算被取消了也算等到了，取消留给下一个等待的地方
+	if (!wmList_is_empty(&co->wait_node)) {
+		wmList_remote(&co->wait_node);
+		co->wait_timeout = true;
+	}
+	return !co->wait_timeout;
+}
+
+/**
+ * 唤醒排在最前面的一个，没有人等返回false
+ */
+static bool sync_wake_one(wmListNode *waiters) {
+	if (wmList_is_empty(waiters)) {
+		return false;
+	}
+	wmListNode *node = waiters->next;
+	wmList_remote(node);
+	wmCoroutine_ready(sync_waiter(node));
+	return true;
+}
+
+static void sync_wake_all(wmListNode *waiters) {
+	while (sync_wake_one(waiters)) {
+	}
+}
+
+/**
+ * 原语要释放了，等着的协程全部按超时处理
+ * 马上就释放了，和channel一样必须直接resume，不能进就绪队列
+ */
+static void sync_abort(wmListNode *waiters) {
+	wmListNode *node;
+	wmCoroutine *co;
+	while (!wmList_is_empty(waiters)) {
+		node = waiters->next;
+		wmList_remote(node);
+		co = sync_waiter(node);
+		co->wait_timeout = true;
+		wmCoroutine_resume(co);
+	}
+}
+
+void wmWaitGroup_init(wmWaitGroup *wg, int64_t count) {
+	wg->count = count;
+	wmList_init(&wg->waiters);
+}
+
+/**
+ * 计数加delta，减到0的时候唤醒所有wait的协程
+ */
+bool wmWaitGroup_add(wmWaitGroup *wg, int64_t delta) {
+	if (wg->count + delta < 0) {
+		wmWarn("negative WaitGroup counter");
+		return false;
+	}
+	wg->count += delta;
+	if (wg->count == 0) {
+		sync_wake_all(&wg->waiters);
+	}
+	return true;
+}
+
+bool wmWaitGroup_wait(wmWaitGroup *wg, double timeout) {
+	if (wg->count == 0) {
+		return true;
+	}
+	return sync_wait(&wg->waiters, timeout);
+}
+
+void wmWaitGroup_destroy(wmWaitGroup *wg) {
+	sync_abort(&wg->waiters);
+}
+
+void wmMutex_init(wmMutex *mutex) {
+	mutex->owner = 0;
+	wmList_init(&mutex->waiters);
+}
+
+/**
+ * 不可重入，自己再锁一次直接返回false，不然就死锁了
+ */
+bool wmMutex_lock(wmMutex *mutex, double timeout) {
+	wmCoroutine *co = wmCoroutine_get_current();
+	if (co == NULL) {
+		wmWarn("must be called in a coroutine");
+		return false;
+	}
+	if (mutex->owner == 0) {
+		mutex->owner = co->cid;
+		return true;
+	}
+	if (mutex->owner == co->cid) {
+		wmWarn("mutex is already locked by this coroutine");
+		return false;
+	}
+	//unlock的时候会直接把owner改成我，醒来就已经拿到锁了
+	return sync_wait(&mutex->waiters, timeout);
+}
+
+bool wmMutex_trylock(wmMutex *mutex) {
+	wmCoroutine *co = wmCoroutine_get_current();
+	if (co == NULL || mutex->owner != 0) {
+		return false;
+	}
+	mutex->owner = co->cid;
+	return true;
+}
+
+/**
+ * 只有持有者能解锁。有人在等的话锁直接交给排第一个的，不会被后来的插队抢走
+ */
+bool wmMutex_unlock(wmMutex *mutex) {
+	wmCoroutine *co = wmCoroutine_get_current();
+	if (co == NULL || mutex->owner != co->cid) {
+		wmWarn("mutex is not locked by this coroutine");
+		return false;
+	}
+	if (wmList_is_empty(&mutex->waiters)) {
+		mutex->owner = 0;
+		return true;
+	}
+	mutex->owner = sync_waiter(mutex->waiters.next)->cid;
+	sync_wake_one(&mutex->waiters);
+	return true;
+}
+
+void wmMutex_destroy(wmMutex *mutex) {
+	sync_abort(&mutex->waiters);
+}
+
+void wmSemaphore_init(wmSemaphore *sem, int64_t permits) {
+	sem->permits = permits;
+	wmList_init(&sem->waiters);
+}
+
+bool wmSemaphore_acquire(wmSemaphore *sem, double timeout) {
+	if (sem->permits > 0) {
+		sem->permits--;
+		return true;
+	}
+	//release的时候许可直接给了我，醒来不用再减
+	return sync_wait(&sem->waiters, timeout);
+}
+
+bool wmSemaphore_tryacquire(wmSemaphore *sem) {
+	if (sem->permits > 0) {
+		sem->permits--;
+		return true;
+	}
+	return false;
+}
+
+void wmSemaphore_release(wmSemaphore *sem) {
+	if (!sync_wake_one(&sem->waiters)) {
+		sem->permits++;
+	}
+}
+
+void wmSemaphore_destroy(wmSemaphore *sem) {
+	sync_abort(&sem->waiters);
+}
+
+void wmBarrier_init(wmBarrier *barrier, uint32_t parties) {
+	barrier->parties = parties;
+	barrier->arrived = 0;
+	barrier->generation = 0;
+	wmList_init(&barrier->waiters);
+}
+
+/**
+ * 最后一个到的不用等，开下一轮，把这一轮的都放走
+ */
+bool wmBarrier_wait(wmBarrier *barrier, double timeout) {
+	if (++barrier->arrived >= barrier->parties) {
+		barrier->arrived = 0;
+		barrier->generation++;
+		sync_wake_all(&barrier->waiters);
+		return true;
+	}
+	if (sync_wait(&barrier->waiters, timeout)) {
+		return true;
+	}
+	//超时了，这一轮还没凑齐，把自己减掉
+	barrier->arrived--;
+	return false;
+}
+
+void wmBarrier_destroy(wmBarrier *barrier) {
+	sync_abort(&barrier->waiters);
+}
+
+/**
+ * 超时
+ * 已经被摘下来的，说明唤醒在前，只是还在就绪队列里面没轮到，这次不算超时
+ */
+static void sync_timeout(void *param) {
+	wmCoroutine *co = (wmCoroutine*) param;
+	co->wait_timer = NULL;
+	if (wmList_is_empty(&co->wait_node)) {
+		return;
+	}
+	wmList_remote(&co->wait_node);
+	co->wait_timeout = true;
+	wmCoroutine_resume(co);
+}
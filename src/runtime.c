@@ -210,7 +210,7 @@ static inline int socket_accept(php_stream *stream, wmSocket *sock, php_stream_x
 	if (timeout) {
 		timeout2 = timeout->tv_sec * 1000 + (uint32_t) timeout->tv_usec / 1000;
 	}
-	wmSocket* clisock = wmSocket_accept(sock, WM_LOOP_AUTO, timeout2);
+	wmSocket* clisock = wmSocket_accept(sock, WM_LOOP_EDGE, timeout2);
 
 	if (clisock == NULL) {
 		error = sock->errCode;
@@ -432,7 +432,7 @@ php_stream *wmRuntime_socket_create(const char *proto, size_t protolen, const ch
 	php_wm_netstream_data_t *abstract;
 	wmSocket *sock;
 
-	sock = wmSocket_create(WM_SOCK_TCP, WM_LOOP_AUTO);
+	sock = wmSocket_create(WM_SOCK_TCP, WM_LOOP_EDGE);
 	if (!sock) {
 		return NULL;
 	}
@@ -43,6 +43,7 @@ static int reload_coro_num = 2; //reload Worker的时候，框架占用的协程
 
 static void acceptConnectionTcp(wmWorker *worker);
 static void acceptConnectionUdp(wmWorker *worker);
+static void connection_start(void *_connection);
 static void parseSocketAddress(wmWorker *worker, zend_string *listen); //解析地址
 static void bind_callback(zval *_This, const char *fun_name, php_fci_fcc **handle_fci_fcc);
 static void checkEnv();
@@ -70,7 +71,10 @@ static void setUserAndGroup(wmWorker *worker);
 static void resetStd(); //重设默认输出到文件
 static void reload(); //平滑重启
 static void writeStatisticsToStatusFile(); //写入status信息
+static void writeCoroutinesToStatusFile(); //写入所有协程的状态和调用栈
 static bool worker_stop(wmWorker *worker);
+static void overload_check(void *_worker);
+static void accept_wait(wmWorker *worker);
 
 //初始化一下参数
 void wmWorker_init() {
@@ -110,6 +114,7 @@ wmWorker* wmWorker_create(zval *_This, zend_string *socketName) {
 	worker->name = NULL;
 	worker->socketName = wmString_dup(socketName->val, socketName->len);
 	worker->stopping = false;
+	worker->priority = WM_PRIORITY_NORMAL;
 	worker->user = NULL;
 	worker->socket = NULL;
 	worker->protocol = NULL;
@@ -190,6 +195,11 @@ void _unlisten(wmWorker *worker) {
 		wmSocket_free(worker->socket);
 		worker->socket = NULL;
 	}
+	//停着的accept协程叫起来，让它自己退出
+	//socket要先释放掉，direct_resume或者loop没跑的时候这里就直接切过去了，看到socket还在又会停回去
+	if (worker->_acceptCoro) {
+		wmCoroutine_ready(worker->_acceptCoro);
+	}
 }
 
 //启动服务器
@@ -366,6 +376,8 @@ void forkOneWorker(wmWorker *worker, int key) {
 
 		//设置当前子进程运行的是哪个worker
 		_main_worker = worker;
+		WorkerG.busy_poll = worker->busyPoll;
+		wmCoroutine_set_stack_size(worker->stackSize);
 
 		//重设标准输出
 		if (_status == WM_WORKER_STATUS_STARTING) {
@@ -389,6 +401,8 @@ void forkOneWorker(wmWorker *worker, int key) {
 		//创建run协程 start
 		zend_fcall_info_cache run;
 		wm_get_internal_function(worker->_This, workerman_worker_ce_ptr, ZEND_STRL("run"), &run);
+		//accept和udp的onMessage都在这个协程下面创建，跟着它的优先级
+		wmCoroutine_set_next_priority(worker->priority);
 		wmCoroutine_create(&run, 0, NULL);
 		//创建run协程 end
 
@@ -487,6 +501,58 @@ void initWorker(wmWorker *worker) {
 		zend_update_property_bool(workerman_worker_ce_ptr, worker->_This, ZEND_STRL("reusePort"), worker->reusePort);
 	}
 
+	//检查忙轮询
+	_zval = wm_zend_read_property_not_null(workerman_worker_ce_ptr, worker->_This, ZEND_STRL("busyPoll"), 0);
+	if (_zval && Z_TYPE_INFO_P(_zval) == IS_LONG) {
+		if (Z_LVAL_P(_zval) < 0 || Z_LVAL_P(_zval) > INT_MAX) {
+			wmError("busyPoll must be between 0 and %d", INT_MAX);
+		}
+		worker->busyPoll = (int) Z_LVAL_P(_zval);
+	}
+
+	//检查协程C栈大小
+	_zval = wm_zend_read_property_not_null(workerman_worker_ce_ptr, worker->_This, ZEND_STRL("stackSize"), 0);
+	if (_zval && Z_TYPE_INFO_P(_zval) == IS_LONG) {
+		if (Z_LVAL_P(_zval) < 0) {
+			wmError("stackSize must be greater than or equal to 0");
+		}
+		worker->stackSize = Z_LVAL_P(_zval);
+	}
+	_zval = wm_zend_read_property_not_null(workerman_worker_ce_ptr, worker->_This, ZEND_STRL("readerStackSize"), 0);
+	if (_zval && Z_TYPE_INFO_P(_zval) == IS_LONG) {
+		if (Z_LVAL_P(_zval) < 0) {
+			wmError("readerStackSize must be greater than or equal to 0");
+		}
+		worker->readerStackSize = Z_LVAL_P(_zval);
+	}
+	_zval = wm_zend_read_property_not_null(workerman_worker_ce_ptr, worker->_This, ZEND_STRL("stacklessRead"), 0);
+	if (_zval) {
+		worker->stacklessRead = zend_is_true(_zval);
+	}
+	_zval = wm_zend_read_property_not_null(workerman_worker_ce_ptr, worker->_This, ZEND_STRL("priority"), 0);
+	if (_zval && Z_TYPE_INFO_P(_zval) == IS_LONG) {
+		if (!wmCoroutine_priority_valid(Z_LVAL_P(_zval))) {
+			wmError("priority must be Coroutine::PRIORITY_HIGH, PRIORITY_NORMAL or PRIORITY_LOW");
+		}
+		worker->priority = (int) Z_LVAL_P(_zval);
+	}
+
+	//检查过载保护的上限
+	_zval = wm_zend_read_property_not_null(workerman_worker_ce_ptr, worker->_This, ZEND_STRL("maxCoroutines"), 0);
+	if (_zval && Z_TYPE_INFO_P(_zval) == IS_LONG) {
+		if (Z_LVAL_P(_zval) < 0) {
+			wmError("maxCoroutines must be greater than or equal to 0");
+		}
+		worker->maxCoroutines = Z_LVAL_P(_zval);
+	}
+	_zval = wm_zend_read_property_not_null(workerman_worker_ce_ptr, worker->_This, ZEND_STRL("maxConnections"), 0);
+	if (_zval && Z_TYPE_INFO_P(_zval) == IS_LONG) {
+		if (Z_LVAL_P(_zval) < 0) {
+			wmError("maxConnections must be greater than or equal to 0");
+		}
+		worker->maxConnections = Z_LVAL_P(_zval);
+	}
+
 	//检查backlog
 	_zval = wm_zend_read_property_not_null(workerman_worker_ce_ptr, worker->_This, ZEND_STRL("backlog"), 0);
 	if (_zval && Z_TYPE_INFO_P(_zval) == IS_LONG) {
@@ -558,12 +624,10 @@ void _kill(void *_pid) {
 
 //worker简易调度器/定时器，由alarm实现
 void alarm_wait() {
-	long mic_time;
 	//检查定时器
 	if (WorkerG.timer.num > 0) {
-		//获取毫秒
-		wmGetMilliTime(&mic_time);
-		wmTimerWheel_update(&WorkerG.timer, mic_time);
+		//获取毫秒，时间轮用的是单调时钟
+		wmTimerWheel_update(&WorkerG.timer, wm_update_now());
 	}
 	alarm(1);
 }
@@ -678,6 +742,25 @@ void checkEnv() {
 		}
 	}
 
+	//选择reactor后端，epoll或者io_uring，子进程创建poll的时候生效
+	_zval = wm_zend_read_static_property_not_null(workerman_worker_ce_ptr, ZEND_STRL("eventLoop"), 0);
+	if (_zval && Z_TYPE_P(_zval) == IS_STRING) {
+		int poll_type = wmPoll_type_by_name(Z_STRVAL_P(_zval));
+		if (poll_type < 0) {
+			wmError("unknown eventLoop: %s", Z_STRVAL_P(_zval));
+		}
+		WorkerG.poll_type = poll_type;
+	}
+
+	//一次wait最多能拿到多少事件，事件数组会在这个范围内自动伸缩
+	_zval = wm_zend_read_static_property_not_null(workerman_worker_ce_ptr, ZEND_STRL("maxEvents"), 0);
+	if (_zval && Z_TYPE_P(_zval) == IS_LONG) {
+		if (Z_LVAL_P(_zval) <= 0 || Z_LVAL_P(_zval) > INT_MAX / (zend_long) sizeof(struct epoll_event)) {
+			wmError("invalid maxEvents: " ZEND_LONG_FMT, Z_LVAL_P(_zval));
+		}
+		WorkerG.max_events = (int) Z_LVAL_P(_zval);
+	}
+
 	// Process title.
 	wm_snprintf(WorkerG.buffer_stack->str, WorkerG.buffer_stack->size, "%.*s: master process start_file=%.*s", (int) _processTitle->length, _processTitle->str,
 		(int) _startFile->length, _startFile->str);
@@ -790,6 +873,7 @@ void parseCommand() {
 		command_type = (strcmp("reload", command->val) == 0 ? 4 : command_type);
 		command_type = (strcmp("status", command->val) == 0 ? 5 : command_type);
 		command_type = (strcmp("connections", command->val) == 0 ? 6 : command_type);
+		command_type = (strcmp("coroutines", command->val) == 0 ? 7 : command_type);
 	}
 
 	if (command_type == 0) {
@@ -797,7 +881,7 @@ void parseCommand() {
 			printf("Unknown command: %s\n", command->val);
 		}
 		printf(
-			"Usage: php yourfile <command> [mode]\nCommands: \nstart\t\tStart worker in DEBUG mode.\n\t\tUse mode -d to start in DAEMON mode.\nstop\t\tStop worker.\n\t\tUse mode -g to stop gracefully.\nrestart\t\tRestart workers.\n\t\tUse mode -d to start in DAEMON mode.\n\t\tUse mode -g to stop gracefully.\nreload\t\tReload codes.\n\t\tUse mode -g to reload gracefully.\nstatus\t\tGet worker status.\n\t\tUse mode -d to show live status.\nconnections\tGet worker connections.\n");
+			"Usage: php yourfile <command> [mode]\nCommands: \nstart\t\tStart worker in DEBUG mode.\n\t\tUse mode -d to start in DAEMON mode.\nstop\t\tStop worker.\n\t\tUse mode -g to stop gracefully.\nrestart\t\tRestart workers.\n\t\tUse mode -d to start in DAEMON mode.\n\t\tUse mode -g to stop gracefully.\nreload\t\tReload codes.\n\t\tUse mode -g to reload gracefully.\nstatus\t\tGet worker status.\n\t\tUse mode -d to show live status.\nconnections\tGet worker connections.\ncoroutines\tDump every coroutine with its wait reason and backtrace.\n");
 		exit(0);
 		return;
 	}
@@ -891,6 +975,20 @@ void parseCommand() {
 		}
 		exit(0);
 		return;
+	case 7: //coroutines
+		if (access(_statisticsFile->str, F_OK) == 0) {
+			remove(_statisticsFile->str);
+		}
+		kill(_masterPid, SIGIO);
+		sleep(1);
+		if (access(_statisticsFile->str, F_OK) == 0) {
+			wmString *_status_buffer = wm_file_get_contents(_statisticsFile->str);
+			//调用栈里面可能有%，不能当格式串
+			fwrite(_status_buffer->str, 1, _status_buffer->length, stdout);
+			wmString_free(_status_buffer);
+		}
+		exit(0);
+		return;
 	default:
 		_log("Unknown command: %s", command->val);
 		exit(0);
@@ -927,8 +1025,15 @@ void acceptConnectionTcp(wmWorker *worker) {
 	//wmWorkerLoop_add(worker->socket, WM_EVENT_EPOLLEXCLUSIVE);
 	wmConnection *conn;
 	zval *__zval;
-	zend_fcall_info_cache call_read;
 	while (worker->_status == WM_WORKER_STATUS_RUNNING) {
+		if (worker->_pauseAccept) {
+			accept_wait(worker);
+			//停着的时候被取消监听了
+			if (worker->socket == NULL || worker->socket->closed) {
+				break;
+			}
+			continue;
+		}
 		wmSocket *socket = wmSocket_accept(worker->socket, WM_LOOP_SEMI_AUTO, WM_SOCKET_MAX_TIMEOUT);
 		if (socket == NULL) {
 			if (worker->_status != WM_WORKER_STATUS_RUNNING || worker->socket->closed) {
@@ -938,6 +1043,10 @@ void acceptConnectionTcp(wmWorker *worker) {
 			continue;
 		}
 
+		if (worker->busyPoll > 0) {
+			wm_socket_busy_poll(socket->fd, worker->busyPoll);
+		}
+
 		conn = wmConnection_create(socket);
 		if (conn == NULL) {
 			wmWarn("_wmWorker_acceptConnection() -> wmConnection_create failed")
@@ -990,15 +1099,126 @@ void acceptConnectionTcp(wmWorker *worker) {
 		conn->onError = worker->onError;
 		//设置回调方法 end
 
-		//onConnect
-		if (worker->onConnect) {
-			wmCoroutine_create(&(worker->onConnect->fcc), 1, z); //创建新协程
+		//onConnect和读协程放到下一轮loop，accept协程可以一口气把队列里的连接都接完
+		Z_ADDREF(conn->_This);
+		wmWorkerLoop_nextTick(connection_start, conn);
+
+		wmWorker_checkOverload(worker);
+	}
+}
+
+/**
+ * 超了上限，accept协程停在这里，等overload_check叫醒
+ * 连接留在内核的accept队列里。开了reusePort的时候，其他进程的队列照常在接
+ */
+static void accept_wait(wmWorker *worker) {
+	//不accept了就别再监听可读，不然loop看到没有协程在等会把监听的socket关掉
+	wmWorkerLoop_remove(worker->socket, WM_EVENT_READ);
+	worker->_acceptCoro = wmCoroutine_get_current();
+	wmCoroutine_set_wait(WM_WAIT_ACCEPT, worker->socket->fd);
+	wmCoroutine_yield();
+	worker->_acceptCoro = NULL;
+}
+
+/**
+ * 看一下有没有超过maxCoroutines、maxConnections，超了就停下accept
+ * onMessage协程超了的话，连接的读协程也在check_read_status里面停下来
+ * 返回现在是不是停着的
+ */
+bool wmWorker_checkOverload(wmWorker *worker) {
+	if (worker == NULL) {
+		return false;
+	}
+	bool coroutines = worker->maxCoroutines > 0 && wmConnection_getRunningMessageNum() >= worker->maxCoroutines;
+	bool connections = worker->maxConnections > 0 && worker->transport == WM_SOCK_TCP
+		&& zend_hash_num_elements(Z_ARRVAL(worker->connections)) >= worker->maxConnections;
+	if (!coroutines && !connections) {
+		return worker->_pauseAccept;
+	}
+	if (coroutines) {
+		worker->_pauseRead = true;
+	}
+	worker->_pauseAccept = true;
+	if (!worker->_overloadTimer) {
+		worker->overloadTimes++;
+		worker->_overloadTimer = wmTimerWheel_add_quick(&WorkerG.timer, overload_check, (void*) worker, WM_WORKER_OVERLOAD_CHECK_INTERVAL);
+	}
+	return true;
+}
+
+/**
+ * 停着的时候定时检查，都降到低水位以下了再恢复，省得在上限附近来回抖
+ */
+static void overload_check(void *_worker) {
+	wmWorker *worker = (wmWorker*) _worker;
+	worker->_overloadTimer = NULL;
+	bool coroutines = worker->maxCoroutines > 0
+		&& wmConnection_getRunningMessageNum() > worker->maxCoroutines * WM_WORKER_LOW_WATERMARK / 100;
+	bool connections = worker->maxConnections > 0 && worker->transport == WM_SOCK_TCP
+		&& zend_hash_num_elements(Z_ARRVAL(worker->connections)) > worker->maxConnections * WM_WORKER_LOW_WATERMARK / 100;
+
+	//读协程只看onMessage协程数
+	if (worker->_pauseRead && !coroutines) {
+		worker->_pauseRead = false;
+		//先把cid记下来再唤醒，直接resume的时候连接可能会关掉，不能边遍历边改connections
+		uint32_t num = 0;
+		long *cids = (long*) emalloc(sizeof(long) * (zend_hash_num_elements(Z_ARRVAL(worker->connections)) + 1));
+		zval *zconn;
+		ZEND_HASH_FOREACH_VAL(Z_ARRVAL(worker->connections), zconn)
+		{
+			wmConnection *conn = wm_connection_fetch_object(Z_OBJ_P(zconn))->connection;
+			//自己调用了pauseRecv的不管
+			if (conn && conn->_pausedCoro && !conn->_isPaused) {
+				cids[num++] = conn->_pausedCoro->cid;
+			} else if (conn) {
+				//stacklessRead的连接没有协程停着，把可读加回来就行
+				wmConnection_watchRead(conn);
+			}
+		}
+		ZEND_HASH_FOREACH_END();
+		for (uint32_t i = 0; i < num; i++) {
+			wmCoroutine *co = wmCoroutine_get_by_cid(cids[i]);
+			if (co) {
+				wmCoroutine_ready(co);
+			}
 		}
-		//创建协程 conn开始读 start
+		efree(cids);
+	}
+	if (coroutines || connections) {
+		worker->_overloadTimer = wmTimerWheel_add_quick(&WorkerG.timer, overload_check, (void*) worker, WM_WORKER_OVERLOAD_CHECK_INTERVAL);
+		return;
+	}
+	worker->_pauseAccept = false;
+	if (worker->_acceptCoro) {
+		wmCoroutine_ready(worker->_acceptCoro);
+	}
+}
+
+/**
+ * 新连接的onConnect和读协程
+ * 先onConnect，再开始读，顺序不能反
+ */
+static void connection_start(void *_connection) {
+	wmConnection *conn = (wmConnection*) _connection;
+	zend_fcall_info_cache call_read;
+	wmWorker *worker = conn->worker;
+	//onConnect，在nextTick里面没有当前协程可以跟，优先级要自己给
+	if (worker->onConnect) {
+		wmCoroutine_set_next_priority(worker->priority);
+		wmCoroutine_create(&(worker->onConnect->fcc), 1, &conn->_This); //创建新协程
+	}
+	//创建协程 conn开始读 start，onConnect里面可能已经close了
+	if (conn->_status == WM_CONNECTION_STATUS_ESTABLISHED && worker->stacklessRead) {
+		//不开读协程，有数据来了再借
+		wmConnection_startStackless(conn);
+	} else if (conn->_status == WM_CONNECTION_STATUS_ESTABLISHED) {
 		wm_get_internal_function(&conn->_This, workerman_connection_ce_ptr, ZEND_STRL("read"), &call_read);
-		wmCoroutine_create(&call_read, 0, NULL);
-		//创建协程 conn开始读  end
+		//读协程大部分时间都在等数据，可以给个小栈
+		wmCoroutine_set_next_priority(worker->priority);
+		wmCoroutine_create_ex(&call_read, 0, NULL, worker->readerStackSize, false);
 	}
+	//创建协程 conn开始读  end
+	zval_ptr_dtor(&conn->_This);
 }
 
 /**
@@ -1009,6 +1229,14 @@ void acceptConnectionUdp(wmWorker *worker) {
 	//死循环accept，遇到消息就新创建协程处理
 	wmConnection *conn;
 	while (!worker->socket->closed) {
+		//udp没有连接，只看onMessage协程数
+		if (worker->_pauseAccept) {
+			accept_wait(worker);
+			if (worker->socket == NULL) {
+				break;
+			}
+			continue;
+		}
 		conn = wmConnection_create_udp(worker->fd);
 		//新的Connection对象
 		zend_object *obj = wm_connection_create_object(workerman_connection_ce_ptr);
@@ -1190,7 +1418,11 @@ void reload() {
 					wmWorker_stopAll();
 					break;
 				}
-				wmCoroutine_sleep(0.1);
+				//被取消了就不等了，不然这里会一直空转
+				if (!wmCoroutine_sleep(0.1)) {
+					wmWorker_stopAll();
+					break;
+				}
 			}
 		}
 	}
@@ -1216,6 +1448,9 @@ void signalHandler(int signal) {
 	case SIGUSR2:		// Show status.
 		writeStatisticsToStatusFile();
 		break;
+	case SIGIO:		// Dump coroutines.
+		writeCoroutinesToStatusFile();
+		break;
 		// Show connection status.
 	}
 }
@@ -1230,6 +1465,8 @@ void installSignal() {
 	signal(SIGUSR1, signalHandler);
 	// status
 	signal(SIGUSR2, signalHandler);
+	// coroutines
+	signal(SIGIO, signalHandler);
 	// ignore
 	signal(SIGPIPE, SIG_IGN); //忽略由于对端连接关闭，导致进程退出的问题
 }
@@ -1244,10 +1481,13 @@ void reinstallSignal() {
 	signal(SIGUSR1, SIG_IGN);
 	// 忽略 status
 	signal(SIGUSR2, SIG_IGN);
+	// 忽略 coroutines
+	signal(SIGIO, SIG_IGN);
 
 	wmSignal_add(SIGINT, signalHandler);
 	wmSignal_add(SIGUSR1, signalHandler);
 	wmSignal_add(SIGUSR2, signalHandler);
+	wmSignal_add(SIGIO, signalHandler);
 
 	//创建signal_wait协程 start
 	zend_fcall_info_cache signal_wait;
@@ -1341,11 +1581,12 @@ void writeStatisticsToStatusFile() {
 			"---------------------------------------<w>PROCESS STATUS</w>-------------------------------------------\n");
 		wm_file_put_contents(_statisticsFile->str, WorkerG.buffer_stack->str, ret, true); //写入PID文件
 
-		ret = wm_snprintf(WorkerG.buffer_stack->str, WorkerG.buffer_stack->size, "%-*s%-*s%-*s%-*s%-*s%-*s\n", //
+		ret = wm_snprintf(WorkerG.buffer_stack->str, WorkerG.buffer_stack->size, "%-*s%-*s%-*s%-*s%-*s%-*s%-*s%-*s%-*s%-*s%-*s\n", //
 			8, "pid", 12, "php_memory", //
 			((int) (_maxSocketNameLength - strlen("listening"))) > 0 ? _maxSocketNameLength + 2 : (strlen("listening") + 2), "listening",  //
 			((int) (_maxWorkerNameLength - strlen("worker_name"))) > 0 ? _maxWorkerNameLength + 2 : (strlen("worker_name") + 2), "worker_name", //
-			13, "connections", 15, "total_request" //
+			13, "connections", 15, "total_request", //
+			14, "loop_p99_us", 14, "loop_max_us", 12, "cb_max_us", 16, "timer_late_ms", 12, "events_cap" //
 			);//
 		wm_file_put_contents(_statisticsFile->str, WorkerG.buffer_stack->str, ret, true); //写入PID文件
 		chmod(_statisticsFile->str, 0722);
@@ -1369,13 +1610,80 @@ void writeStatisticsToStatusFile() {
 	char _total_request_num[10];
 	wm_itoa(_total_request_num, wmConnection_getTotalRequestNum());
 
-	int ret = wm_snprintf(WorkerG.buffer_stack->str, WorkerG.buffer_stack->size, "%-*s%-*s%-*s%-*s%-*s%-*s\n", //
+	//loop的统计，一个onMessage阻塞住了，这里就能看出来
+	wmWorkerLoop_stats *stats = wmWorkerLoop_get_stats();
+	char _loop_p99[21];
+	wm_snprintf(_loop_p99, sizeof(_loop_p99), "%" PRIu64, wmHistogram_percentile(&stats->iteration, 99));
+	char _loop_max[21];
+	wm_snprintf(_loop_max, sizeof(_loop_max), "%" PRIu64, stats->iteration.max);
+	char _cb_max[21];
+	wm_snprintf(_cb_max, sizeof(_cb_max), "%" PRIu64, stats->callback.max);
+	char _timer_late[21];
+	wm_snprintf(_timer_late, sizeof(_timer_late), "%" PRIu64, wmHistogram_percentile(&stats->timer_lateness, 99));
+
+	//事件数组现在的大小
+	char _events_cap[12];
+	wm_itoa(_events_cap, WorkerG.poll ? WorkerG.poll->ncap : 0);
+
+	//进程这一行和CPU时间最多的几个协程拼在一起一次写进去，省得和别的进程交错
+	//协程名字带着文件的绝对路径，buffer_stack放不下，拼到wmString里面
+	wmString *out = wmString_new(WM_BUFFER_SIZE_BIG);
+	int ret = wm_snprintf(WorkerG.buffer_stack_large->str, WorkerG.buffer_stack_large->size, "%-*s%-*s%-*s%-*s%-*s%-*s%-*s%-*s%-*s%-*s%-*s\n", //
 		8, _pid, 12, _memory, //
 		((int) (_maxSocketNameLength - strlen("listening"))) > 0 ? _maxSocketNameLength + 2 : (strlen("listening") + 2), _main_worker->socketName->str,  //
 		((int) (_maxWorkerNameLength - strlen("worker_name"))) > 0 ? _maxWorkerNameLength + 2 : (strlen("worker_name") + 2), _main_worker->name->str, //
-		13, _conn_num, 15, _total_request_num //
+		13, _conn_num, 15, _total_request_num, //
+		14, _loop_p99, 14, _loop_max, 12, _cb_max, 16, _timer_late, 12, _events_cap //
 		);//
-	wm_file_put_contents(_statisticsFile->str, WorkerG.buffer_stack->str, ret, true); //写入PID文件
+	//截断了的话换行也没了，补回去，不然下一个进程的那一行就接在后面了
+	if (ret >= WorkerG.buffer_stack_large->size - 1) {
+		ret = WorkerG.buffer_stack_large->size - 1;
+		WorkerG.buffer_stack_large->str[ret - 1] = '\n';
+	}
+	wmString_append_ptr(out, WorkerG.buffer_stack_large->str, ret);
+
+	wmCoroutine *top[WM_STATUS_TOP_COROUTINES];
+	int top_num = wmCoroutine_top(top, WM_STATUS_TOP_COROUTINES);
+	char _name[128];
+	char _line[256];
+	for (int i = 0; i < top_num; i++) {
+		wmCoroutine_get_name(top[i], _name, sizeof(_name));
+		ret = wm_snprintf(_line, sizeof(_line), "    cid:%ld cpu_ms:%.2f switches:%u %s\n", top[i]->cid, (double) wmCoroutine_get_cpu_time(top[i]) / 1000000,
+			top[i]->switches, _name);
+		if (ret >= sizeof(_line) - 1) {
+			ret = sizeof(_line) - 1;
+			_line[ret - 1] = '\n';
+		}
+		wmString_append_ptr(out, _line, ret);
+	}
+	wm_file_put_contents(_statisticsFile->str, out->str, out->length, true); //写入PID文件
+	wmString_free(out);
+}
+
+/**
+ * 所有协程的状态和调用栈，和status一样写进状态文件
+ * 主进程只写个标题，再转给子进程，每个子进程一次写完，省得和别的进程交错
+ */
+void writeCoroutinesToStatusFile() {
+	if (_masterPid == getpid()) {
+		int ret = wm_snprintf(WorkerG.buffer_stack->str, WorkerG.buffer_stack->size,
+			"---------------------------------------COROUTINES-----------------------------------------------\n");
+		wm_file_put_contents(_statisticsFile->str, WorkerG.buffer_stack->str, ret, true);
+		chmod(_statisticsFile->str, 0722);
+		getAllWorkerPids();
+		for (int i = 0; i < _pid_array_tmp->offset; i++) {
+			int *pid = wmArray_find(_pid_array_tmp, i);
+			kill(*pid, SIGIO);
+		}
+		return;
+	}
+	wmString *out = wmString_new(WM_BUFFER_SIZE_BIG);
+	int ret = wm_snprintf(WorkerG.buffer_stack->str, WorkerG.buffer_stack->size, "pid:%d worker:%s coroutines:%d\n", getpid(), _main_worker->name->str,
+		wmCoroutine_getTotalNum());
+	wmString_append_ptr(out, WorkerG.buffer_stack->str, ret);
+	wmCoroutine_dump(out);
+	wm_file_put_contents(_statisticsFile->str, out->str, out->length, true);
+	wmString_free(out);
 }
 
 /**
@@ -1459,6 +1767,10 @@ wmWorker* wmWorker_find_by_fd(int fd) {
 
 void wmWorker_free(wmWorker *worker) {
 	_unlisten(worker);
+	if (worker->_overloadTimer) {
+		wmTimerWheel_del(&WorkerG.timer, worker->_overloadTimer);
+		worker->_overloadTimer = NULL;
+	}
 	if (worker->socketName != NULL) {
 		wmString_free(worker->socketName);
 	}
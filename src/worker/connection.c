@@ -6,11 +6,13 @@ static long wm_coroutine_socket_last_id = 0;
 static wmHash_INT_PTR *wm_connections = NULL; //记录着正在连接状态的conn
 static wmString *_read_buffer_tmp = NULL; //每次read都从这里中转
 static long total_request = 0; //处理消息总数
+static long running_message = 0; //正在跑的onMessage协程数
 static socklen_t addr_len = sizeof(struct sockaddr);
 
 //检查是否发送缓存区慢
 static void bufferWillFull(void *_connection);
 static void onError(wmConnection *connection);
+static bool connection_readable(wmSocket *socket, int event);
 
 /**
  * 检查read连接状态
@@ -19,8 +21,12 @@ bool check_read_status(wmConnection *connection) {
 	if (connection->worker->_status != WM_WORKER_STATUS_RUNNING || connection->_status != WM_CONNECTION_STATUS_ESTABLISHED) {
 		return false;
 	}
-	if (connection->_isPaused) {
+	//自己暂停了，或者worker的onMessage协程超了上限，醒来之后还要再看一下
+	while (connection->_isPaused || connection->worker->_pauseRead) {
+		//停着的时候别再监听可读，不然数据来了没有协程在等，loop会把连接关掉
+		wmWorkerLoop_remove(connection->socket, WM_EVENT_READ);
 		connection->_pausedCoro = wmCoroutine_get_current();
+		wmCoroutine_set_wait(WM_WAIT_PAUSED, connection->fd);
 		wmCoroutine_yield();
 		connection->_pausedCoro = NULL;
 		if (connection->_status == WM_CONNECTION_STATUS_CLOSED) {
@@ -33,6 +39,7 @@ bool check_read_status(wmConnection *connection) {
 void wmConnection_init() {
 	wm_connections = wmHash_init(WM_HASH_INT_STR);
 	_read_buffer_tmp = wmString_new(WM_BUFFER_SIZE_BIG);
+	wmWorkerLoop_set_handler(WM_EVENT_READ, WM_LOOP_CALLBACK, connection_readable);
 }
 
 wmConnection* wmConnection_create(wmSocket *socket) {
@@ -63,6 +70,7 @@ wmConnection* wmConnection_create(wmSocket *socket) {
 	connection->onError = NULL;
 	connection->_isPaused = false;
 	connection->_pausedCoro = NULL;
+	connection->_reading = false;
 
 	connection->read_packet_buffer = NULL;
 	if (connection->id < 0) {
@@ -108,6 +116,7 @@ wmConnection* wmConnection_find_by_fd(int fd) {
  * onMessage协程结束调用
  */
 void onMessage_callback(void *_mess_data) {
+	running_message--;
 	zval *md = (zval*) _mess_data;
 	zval *md2 = (zval*) ((char*) _mess_data + sizeof(zval));
 	zval_ptr_dtor(md2);
@@ -115,6 +124,7 @@ void onMessage_callback(void *_mess_data) {
 }
 
 void onMessage_callback_udp(void *_mess_data) {
+	running_message--;
 	zval *md = (zval*) _mess_data;
 	zval *md2 = (zval*) ((char*) _mess_data + sizeof(zval));
 	zval_ptr_dtor(md2);
@@ -133,16 +143,121 @@ void onError_callback(void *_mess_data) {
 	efree(md);
 }
 
+/**
+ * 处理读到的一段数据，有协议的话拆包，完整的包交给onMessage协程
+ * 连接已经关掉或者不用再读了返回false
+ */
+static bool connection_input(wmConnection *connection, int ret) {
+	zval z1;
+	zval retval_ptr;
+	/**
+	 * 如果只是单纯的tcp协议
+	 */
+	wmWorker *worker = connection->worker;
+
+	if (worker->protocol) {
+		wmString *read_packet_buffer = connection->read_packet_buffer;
+		if (read_packet_buffer == NULL) {
+			read_packet_buffer = wmString_new(ret);
+		}
+		wmString_append_ptr(read_packet_buffer, _read_buffer_tmp->str, ret);
+
+		/**
+		 * 在这里不断的判断是否是整包
+		 */
+		while ((read_packet_buffer->length - read_packet_buffer->offset) > 0 && check_read_status(connection)) {
+			/**
+			 * 调用input
+			 */
+			ZVAL_STR(&z1,
+				zend_string_init((read_packet_buffer->str + read_packet_buffer->offset), read_packet_buffer->length - read_packet_buffer->offset, 0));
+			//调用协议的input方法
+			zend_call_method(NULL, worker->protocol_ce, NULL, ZEND_STRL("input"), &retval_ptr, 2, &z1, &connection->_This);
+			zval_ptr_dtor(&z1);
+
+			if (UNEXPECTED(EG(exception))) {
+				zend_exception_error(EG(exception), E_ERROR);
+			}
+
+			//判断是否是一个完整的协议包
+			if (Z_TYPE(retval_ptr) == IS_LONG) { //判断是否返回的是数字
+				zend_long packet_len = Z_LVAL(retval_ptr);
+				if (packet_len == 0) {
+					break;
+				}
+				if (packet_len > connection->maxPackageSize) {
+					wmWarn("Error package. package_length=%ld", packet_len);
+					wmConnection_destroy(connection);
+					return false;
+				}
+
+				//创建一个单独协程处理包
+				total_request++;
+				if (connection->onMessage) {
+					//解码
+					ZVAL_STR(&z1, zend_string_init((read_packet_buffer->str + read_packet_buffer->offset), packet_len, 0));
+					zend_call_method(NULL, worker->protocol_ce, NULL, ZEND_STRL("decode"), &retval_ptr, 2, &z1, &connection->_This);
+					zval_ptr_dtor(&z1);
+
+					//构建zval，默认的引用计数是1，在php方法调用完毕释放
+					zval *_mess_data = (zval*) emalloc(sizeof(zval) * 2);
+					ZVAL_COPY_VALUE(_mess_data, &connection->_This);
+					ZVAL_COPY_VALUE(&_mess_data[1], &retval_ptr);
+
+					//协程可能一口气跑完，回调里面会减，所以先加
+					running_message++;
+					long _cid = wmCoroutine_create(&(connection->onMessage->fcc), 2, _mess_data); //创建新协程
+					wmCoroutine_set_callback(_cid, onMessage_callback, _mess_data);
+					wmWorker_checkOverload(worker);
+				}
+				read_packet_buffer->offset += packet_len;
+			} else { //其他类型直接协议错误
+				zval_ptr_dtor(&retval_ptr);
+				wmSocket_close(connection->socket);
+				connection->socket->errCode = WM_ERROR_PROTOCOL_FAIL;
+				connection->socket->errMsg = wmCode_str(WM_ERROR_PROTOCOL_FAIL);
+				onError(connection);
+				return false;
+			}
+		}
+
+		//大于0代表有消息被onMessage处理了，重新创建string缓冲区
+		if (read_packet_buffer->offset > 0) {
+			//重新创建一个read_packet缓冲区
+			int residue_buffer_len = read_packet_buffer->length - read_packet_buffer->offset;
+			connection->read_packet_buffer = wmString_dup(read_packet_buffer->str + read_packet_buffer->offset, residue_buffer_len);
+			wmString_free(read_packet_buffer);
+		}
+		return true;
+	}
+
+	if (!check_read_status(connection)) {
+		return false;
+	}
+
+	total_request++;
+	//创建一个单独协程处理
+	if (connection->onMessage) {
+		//构建zval，默认的引用计数是1，在php方法调用完毕释放
+		zval *_mess_data = (zval*) emalloc(sizeof(zval) * 2);
+		ZVAL_COPY_VALUE(_mess_data, &connection->_This);
+		zend_string *_zs = zend_string_init(_read_buffer_tmp->str, ret, 0);
+		ZVAL_STR(&_mess_data[1], _zs);
+		running_message++;
+		long _cid = wmCoroutine_create(&(connection->onMessage->fcc), 2, _mess_data); //创建新协程
+		wmCoroutine_set_callback(_cid, onMessage_callback, _mess_data);
+		wmWorker_checkOverload(connection->worker);
+	}
+	return true;
+}
+
 /**
  * 开始读消息
  * 在一个新协程环境运行
  */
 void wmConnection_read(wmConnection *connection) {
-	zval z1;
-	zval retval_ptr;
 	//开始读消息
 	while (check_read_status(connection)) {
-		///////////////////
 		int ret = wmSocket_read(connection->socket, _read_buffer_tmp->str, _read_buffer_tmp->size, WM_SOCKET_MAX_TIMEOUT);
 		//触发onError
 		if (ret == WM_SOCKET_ERROR) {
@@ -154,101 +269,96 @@ void wmConnection_read(wmConnection *connection) {
 			wmConnection_destroy(connection);
 			return;
 		}
-		/**
-		 * 如果只是单纯的tcp协议
-		 */
-		wmWorker *worker = connection->worker;
-
-		if (worker->protocol) {
-			wmString *read_packet_buffer = connection->read_packet_buffer;
-			if (read_packet_buffer == NULL) {
-				read_packet_buffer = wmString_new(ret);
-			}
-			wmString_append_ptr(read_packet_buffer, _read_buffer_tmp->str, ret);
-
-			/**
-			 * 在这里不断的判断是否是整包
-			 */
-			while ((read_packet_buffer->length - read_packet_buffer->offset) > 0 && check_read_status(connection)) {
-				/**
-				 * 调用input
-				 */
-				ZVAL_STR(&z1,
-					zend_string_init((read_packet_buffer->str + read_packet_buffer->offset), read_packet_buffer->length - read_packet_buffer->offset, 0));
-				//调用协议的input方法
-				zend_call_method(NULL, worker->protocol_ce, NULL, ZEND_STRL("input"), &retval_ptr, 2, &z1, &connection->_This);
-				zval_ptr_dtor(&z1);
+		if (!connection_input(connection, ret)) {
+			return;
+		}
+	}
+}
 
-				if (UNEXPECTED(EG(exception))) {
-					zend_exception_error(EG(exception), E_ERROR);
-				}
+/**
+ * stacklessRead：连接不再常驻一个读协程，平时只是loop里面的一个可读注册
+ */
+void wmConnection_startStackless(wmConnection *connection) {
+	connection->socket->loop_type = WM_LOOP_CALLBACK;
+	wmConnection_watchRead(connection);
+}
 
-				//判断是否是一个完整的协议包
-				if (Z_TYPE(retval_ptr) == IS_LONG) { //判断是否返回的是数字
-					zend_long packet_len = Z_LVAL(retval_ptr);
-					if (packet_len == 0) {
-						break;
-					}
-					if (packet_len > connection->maxPackageSize) {
-						wmWarn("Error package. package_length=%ld", packet_len);
-						wmConnection_destroy(connection);
-						return;
-					}
-
-					//创建一个单独协程处理包
-					total_request++;
-					if (connection->onMessage) {
-						//解码
-						ZVAL_STR(&z1, zend_string_init((read_packet_buffer->str + read_packet_buffer->offset), packet_len, 0));
-						zend_call_method(NULL, worker->protocol_ce, NULL, ZEND_STRL("decode"), &retval_ptr, 2, &z1, &connection->_This);
-						zval_ptr_dtor(&z1);
-
-						//构建zval，默认的引用计数是1，在php方法调用完毕释放
-						zval *_mess_data = (zval*) emalloc(sizeof(zval) * 2);
-						ZVAL_COPY_VALUE(_mess_data, &connection->_This);
-						ZVAL_COPY_VALUE(&_mess_data[1], &retval_ptr);
-
-						long _cid = wmCoroutine_create(&(connection->onMessage->fcc), 2, _mess_data); //创建新协程
-						wmCoroutine_set_callback(_cid, onMessage_callback, _mess_data);
-					}
-					read_packet_buffer->offset += packet_len;
-				} else { //其他类型直接协议错误
-					zval_ptr_dtor(&retval_ptr);
-					wmSocket_close(connection->socket);
-					connection->socket->errCode = WM_ERROR_PROTOCOL_FAIL;
-					connection->socket->errMsg = wmCode_str(WM_ERROR_PROTOCOL_FAIL);
-					onError(connection);
-					return;
-				}
-			}
+/**
+ * WM_LOOP_CALLBACK的可读回调，在loop里面执行
+ * 有数据来了才借一个协程去读，读完协程结束，C栈和PHP栈都还回池子里
+ */
+static bool connection_readable(wmSocket *socket, int event) {
+	wmConnection *connection = (wmConnection*) socket->owner;
+	zend_fcall_info_cache call_read;
+	if (socket->read_co) {
+		return wmCoroutine_resume(socket->read_co);
+	}
+	//正在读的会自己把事件加回来，暂停着的等恢复的时候再加
+	if (connection == NULL || connection->_status != WM_CONNECTION_STATUS_ESTABLISHED || connection->_reading || connection->_isPaused
+		|| connection->worker->_pauseRead) {
+		wmWorkerLoop_remove(socket, WM_EVENT_READ);
+		return true;
+	}
+	wm_get_internal_function(&connection->_This, workerman_connection_ce_ptr, ZEND_STRL("readReady"), &call_read);
+	wmCoroutine_set_next_priority(connection->worker->priority);
+	wmCoroutine_create_ex(&call_read, 0, NULL, connection->worker->readerStackSize, false);
+	return true;
+}
 
-			//大于0代表有消息被onMessage处理了，重新创建string缓冲区
-			if (read_packet_buffer->offset > 0) {
-				//重新创建一个read_packet缓冲区
-				int residue_buffer_len = read_packet_buffer->length - read_packet_buffer->offset;
-				connection->read_packet_buffer = wmString_dup(read_packet_buffer->str + read_packet_buffer->offset, residue_buffer_len);
-				wmString_free(read_packet_buffer);
-			}
-			continue;
+/**
+ * 在借来的协程里面读，读到EAGAIN或者读满WM_CONNECTION_READ_BURST次就结束
+ * 读的时候先不监听可读，免得协程停在onMessage或者暂停里面的时候，loop又借一个协程进来
+ * 同一轮loop里面删了又加，不会真的调用epoll_ctl
+ * 借来的协程没有拿着连接对象，中间destroy了connection就会被释放，所以整个过程自己加一个引用
+ */
+void wmConnection_readReady(wmConnection *connection) {
+	int ret;
+	int burst = 0;
+	Z_ADDREF(connection->_This);
+	connection->_reading = true;
+	wmWorkerLoop_remove(connection->socket, WM_EVENT_READ);
+	while (check_read_status(connection)) {
+		ret = wmSocket_read_nowait(connection->socket, _read_buffer_tmp->str, _read_buffer_tmp->size);
+		//读空了
+		if (ret == WM_SOCKET_SUCCESS) {
+			break;
 		}
-
-		if (!check_read_status(connection)) {
-			return;
+		if (ret == WM_SOCKET_ERROR) {
+			connection->_reading = false;
+			onError(connection);
+			//没有读协程兜底了，出错的连接直接关掉
+			wmConnection_destroy(connection);
+			break;
 		}
-
-		total_request++;
-		//创建一个单独协程处理
-		if (connection->onMessage) {
-			//构建zval，默认的引用计数是1，在php方法调用完毕释放
-			zval *_mess_data = (zval*) emalloc(sizeof(zval) * 2);
-			ZVAL_COPY_VALUE(_mess_data, &connection->_This);
-			zend_string *_zs = zend_string_init(_read_buffer_tmp->str, ret, 0);
-			ZVAL_STR(&_mess_data[1], _zs);
-			long _cid = wmCoroutine_create(&(connection->onMessage->fcc), 2, _mess_data); //创建新协程
-			wmCoroutine_set_callback(_cid, onMessage_callback, _mess_data);
+		if (ret == WM_SOCKET_CLOSE) {
+			wmConnection_destroy(connection);
+			break;
+		}
+		if (!connection_input(connection, ret)) {
+			break;
+		}
+		if (++burst >= WM_CONNECTION_READ_BURST) {
+			break;
 		}
-		continue;
 	}
+	connection->_reading = false;
+	//已经关掉的watchRead里面会跳过
+	wmConnection_watchRead(connection);
+	zval_ptr_dtor(&connection->_This);
+}
+
+/**
+ * stacklessRead的连接重新监听可读
+ * 正在读的、暂停着的、已经关掉的不用加
+ */
+void wmConnection_watchRead(wmConnection *connection) {
+	if (connection->_status != WM_CONNECTION_STATUS_ESTABLISHED || connection->_isPaused || connection->worker->_pauseRead) {
+		return;
+	}
+	if (connection->socket == NULL || connection->socket->loop_type != WM_LOOP_CALLBACK || connection->_reading) {
+		return;
+	}
+	wmWorkerLoop_add(connection->socket, WM_EVENT_READ);
 }
 
 /**
@@ -263,8 +373,10 @@ void wmConnection_recvfrom(wmConnection *connection, wmSocket *socket) {
 		ZVAL_COPY_VALUE(_mess_data, &connection->_This);
 		zend_string *_zs = zend_string_init(_read_buffer_tmp->str, ret, 0);
 		ZVAL_STR(&_mess_data[1], _zs);
+		running_message++;
 		long _cid = wmCoroutine_create(&(connection->onMessage->fcc), 2, _mess_data); //创建新协程
 		wmCoroutine_set_callback(_cid, onMessage_callback_udp, _mess_data);
+		wmWorker_checkOverload(connection->worker);
 	}
 }
 
@@ -335,11 +447,26 @@ void wmConnection_consumeRecvBuffer(wmConnection *connection, zend_long length)
 	}
 }
 
+/**
+ * nextTick里面触发onBufferFull
+ * 放进队列的时候给connection对象加过引用，这里减掉
+ */
+static void onBufferFull_tick(void *_connection) {
+	wmConnection *connection = (wmConnection*) _connection;
+	if (connection->onBufferFull) {
+		wmCoroutine_set_next_priority(connection->worker->priority);
+		wmCoroutine_create(&(connection->onBufferFull->fcc), 1, &connection->_This); //创建新协程
+	}
+	zval_ptr_dtor(&connection->_This);
+}
+
 //应用层发送缓冲区是否这次添加之后，已经满了
+//这里还在send的调用栈里面，回调放到下一轮loop去执行
 void bufferWillFull(void *_connection) {
 	wmConnection *connection = (wmConnection*) _connection;
 	if (connection->onBufferFull) {
-		wmCoroutine_create(&(connection->onBufferFull->fcc), 1, &connection->_This); //创建新协程
+		Z_ADDREF(connection->_This);
+		wmWorkerLoop_nextTick(onBufferFull_tick, connection);
 	}
 }
 
@@ -371,6 +498,13 @@ long wmConnection_getTotalRequestNum() {
 	return total_request;
 }
 
+/**
+ * 正在跑的onMessage协程数，Worker::$maxCoroutines限制的就是这个
+ */
+long wmConnection_getRunningMessageNum() {
+	return running_message;
+}
+
 /**
  * 获取对端IP
  */
@@ -398,8 +532,10 @@ void wmConnection_pauseRecv(wmConnection *connection) {
 void wmConnection_resumeRecv(wmConnection *connection) {
 	connection->_isPaused = false;
 	if (connection->_pausedCoro) {
-		wmCoroutine_resume(connection->_pausedCoro);
+		wmCoroutine_ready(connection->_pausedCoro);
+		return;
 	}
+	wmConnection_watchRead(connection);
 }
 
 /**
@@ -426,6 +562,17 @@ void onError(wmConnection *connection) {
 	}
 }
 
+/**
+ * nextTick里面触发onClose
+ * 放进队列的时候给connection对象加过引用，这里减掉，connection可能就此释放
+ */
+static void onClose_tick(void *_connection) {
+	wmConnection *connection = (wmConnection*) _connection;
+	wmCoroutine_set_next_priority(connection->worker->priority);
+	wmCoroutine_create(&(connection->onClose->fcc), 1, &connection->_This); //创建新协程
+	zval_ptr_dtor(&connection->_This);
+}
+
 /**
  * 直接关闭这个连接
  */
@@ -438,12 +585,14 @@ int wmConnection_destroy(wmConnection *connection) {
 	connection->_isPaused = false;
 	int ret = wmSocket_close(connection->socket);
 	//开始恢复被暂停的协程
+	//必须直接resume，下面connection可能就释放了，进就绪队列的话醒来再碰connection就是野指针
 	if (connection->_pausedCoro) {
 		wmCoroutine_resume(connection->_pausedCoro);
 	}
-	//触发onClose
+	//触发onClose，放到下一轮loop，大量连接同时断开的时候一起处理
 	if (connection->onClose) {
-		wmCoroutine_create(&(connection->onClose->fcc), 1, &connection->_This); //创建新协程
+		Z_ADDREF(connection->_This);
+		wmWorkerLoop_nextTick(onClose_tick, connection);
 	}
 
 	//从connections数组中删除
@@ -5,6 +5,7 @@
 
 static loop_callback_func_t read_handler[7];
 static loop_callback_func_t write_handler[7];
+static wmWorkerLoop_stats loop_stats;
 
 //把我们自己的events转换成epoll的
 static inline int event_decode(int events) {
@@ -25,6 +26,19 @@ static inline int event_decode(int events) {
 	return flag;
 }
 
+/**
+ * 边缘触发的事件来了叫醒等着的协程
+ * 低优先级的不马上切进去，放进就绪队列，让这一轮的事件和高优先级的协程先跑
+ * 只有边缘触发能这样排队，水平触发的fd没轮到之前每一轮wait都会再报一次，白白空转
+ */
+static inline bool loop_wake(wmCoroutine *co) {
+	if (co->priority == WM_PRIORITY_LOW) {
+		wmCoroutine_ready(co);
+		return true;
+	}
+	return wmCoroutine_resume(co);
+}
+
 /**
  * 恢复协程&用于loop_wait回调
  */
@@ -49,6 +63,46 @@ bool loop_callback_coroutine_resume_and_del(wmSocket *socket, int event) {
 	return loop_callback_coroutine_resume(socket, event);
 }
 
+/**
+ * 边缘触发：记下就绪状态，有协程在等就唤醒
+ * 这里不能像上面那样关闭socket，没人等的时候就绪状态留给下一次读写用
+ */
+bool loop_callback_coroutine_edge(wmSocket *socket, int event) {
+	if (event == EPOLLIN) {
+		if (socket->read_co) {
+			return loop_wake(socket->read_co);
+		}
+		socket->ready |= WM_EVENT_READ;
+	} else if (event == EPOLLOUT) {
+		if (socket->write_co) {
+			return loop_wake(socket->write_co);
+		}
+		socket->ready |= WM_EVENT_WRITE;
+	}
+	return true;
+}
+
+/**
+ * 边缘触发的事件预处理
+ * 没人等的方向先记到ready上，只把有协程在等的方向交给handler。
+ * 读协程被唤醒以后可能直接把socket释放了，所以写方向要在这之前处理好
+ */
+static inline uint32_t edge_filter(wmSocket *socket, uint32_t revents) {
+	//出错和挂断只会通知一次，读写两边都要叫醒
+	if (revents & (EPOLLERR | EPOLLHUP)) {
+		revents |= EPOLLIN | EPOLLOUT;
+	}
+	if ((revents & EPOLLIN) && !socket->read_co) {
+		socket->ready |= WM_EVENT_READ;
+		revents &= ~EPOLLIN;
+	}
+	if ((revents & EPOLLOUT) && !socket->write_co) {
+		socket->ready |= WM_EVENT_WRITE;
+		revents &= ~EPOLLOUT;
+	}
+	return revents;
+}
+
 /**
  * 初始化loop需要的东西
  */
@@ -58,6 +112,11 @@ int loop_init() {
 		wmWorkerLoop_set_handler(WM_EVENT_WRITE, WM_LOOP_SEMI_AUTO, loop_callback_coroutine_resume);
 		wmWorkerLoop_set_handler(WM_EVENT_READ, WM_LOOP_AUTO, loop_callback_coroutine_resume_and_del);
 		wmWorkerLoop_set_handler(WM_EVENT_WRITE, WM_LOOP_AUTO, loop_callback_coroutine_resume_and_del);
+		wmWorkerLoop_set_handler(WM_EVENT_READ, WM_LOOP_EDGE, loop_callback_coroutine_edge);
+		wmWorkerLoop_set_handler(WM_EVENT_WRITE, WM_LOOP_EDGE, loop_callback_coroutine_edge);
+		//WM_LOOP_CALLBACK的读回调由使用方自己注册
+		wmWorkerLoop_set_handler(WM_EVENT_WRITE, WM_LOOP_CALLBACK, loop_callback_coroutine_resume);
+		bzero(&loop_stats, sizeof(loop_stats));
 		return init_wmPoll();
 	}
 	return 0;
@@ -100,32 +159,190 @@ loop_callback_func_t wmWorkerLoop_get_handler(int event, int type) {
 	return NULL;
 }
 
-bool wmWorkerLoop_add(wmSocket *socket, int event) {
-	if (socket->events & event) { //如果socket里面有这个事件,那直接返回
-		return true;
+/**
+ * 这一轮loop里面监听事件有变化的socket
+ * 先只改socket->events，等到epoll_wait之前再一次性同步给内核，
+ * 同一轮里面加了又删的，就不用调用epoll_ctl了
+ */
+static wmSocket **pending_list = NULL;
+static int pending_num = 0;
+static int pending_size = 0;
+
+static void pending_push(wmSocket *socket) {
+	if (socket->pending >= 0) {
+		return;
+	}
+	if (pending_num == pending_size) {
+		int size = pending_size > 0 ? pending_size * 2 : 64;
+		wmSocket **list = (wmSocket**) wm_realloc(pending_list, sizeof(wmSocket*) * size);
+		if (list == NULL) {
+			wmError("Error has occurred: (errno %d) %s", errno, strerror(errno));
+		}
+		pending_list = list;
+		pending_size = size;
+	}
+	socket->pending = pending_num;
+	pending_list[pending_num++] = socket;
+}
+
+/**
+ * socket记着自己的下标，最后一个挪过来补上，大量连接同时关闭的时候不用一个个找
+ * flush的时候处理过的都已经不在列表里了，挪过来的一定是还没处理的
+ */
+static void pending_remove(wmSocket *socket) {
+	int index = socket->pending;
+	if (index < 0) {
+		return;
+	}
+	socket->pending = -1;
+	pending_num--;
+	if (index != pending_num) {
+		pending_list[index] = pending_list[pending_num];
+		pending_list[index]->pending = index;
+	}
+	pending_list[pending_num] = NULL;
+}
+
+/**
+ * 注册的事件同步失败了，这个socket已经没法用loop了，当成断开处理
+ */
+static void pending_fail(wmSocket *socket) {
+	socket->errCode = errno;
+	socket->errMsg = wmCode_str(errno);
+	socket->closed = true;
+	socket->events = socket->poll_events;
+	if (socket->read_co) {
+		wmCoroutine_resume(socket->read_co);
+	}
+	if (socket->write_co) {
+		wmCoroutine_resume(socket->write_co);
 	}
+}
 
-	int LOOP_TYPE = EPOLL_CTL_MOD;
+/**
+ * 把socket->events同步到内核
+ */
+static void pending_apply(wmSocket *socket) {
+	int op;
+	struct epoll_event ev;
+	if (socket->events == socket->poll_events) {
+		return;
+	}
 	if (socket->events == WM_EVENT_NULL) {
-		LOOP_TYPE = EPOLL_CTL_ADD;
+		if (wmPoll_ctl(EPOLL_CTL_DEL, socket->fd, NULL) < 0) {
+			wmWarn("Error has occurred: fd=%d (errno %d) %s", socket->fd, errno, strerror(errno));
+		}
+		socket->poll_events = WM_EVENT_NULL;
+		WorkerG.poll->event_num--;
+		return;
+	}
+	op = socket->poll_events == WM_EVENT_NULL ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+	if (socket->loop_type == WM_LOOP_EDGE) {
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+	} else {
+		//转换epoll能看懂的事件类型
+		ev.events = event_decode(socket->events);
+	}
+	ev.data.ptr = socket;
+	if (wmPoll_ctl(op, socket->fd, &ev) < 0) {
+		wmWarn("Error has occurred: fd=%d (errno %d) %s", socket->fd, errno, strerror(errno));
+		pending_fail(socket);
+		return;
+	}
+	if (op == EPOLL_CTL_ADD) {
+		WorkerG.poll->event_num++;
+	}
+	socket->poll_events = socket->events;
+}
+
+/**
+ * 在epoll_wait之前调用，把这一轮攒下来的变化提交掉
+ * pending_fail会唤醒协程，协程里面可能又有新的变化进来，所以每次都重新读pending_num
+ */
+void wmWorkerLoop_flush() {
+	for (int i = 0; i < pending_num; i++) {
+		wmSocket *socket = pending_list[i];
+		if (socket == NULL) {
+			continue;
+		}
+		socket->pending = -1;
+		pending_list[i] = NULL;
+		pending_apply(socket);
+	}
+	pending_num = 0;
+}
+
+/**
+ * 下一轮loop再执行的任务
+ * 执行的时候只跑进来时已经有的，执行过程中新加的留到下一轮，免得一直占着loop
+ */
+typedef struct {
+	wmWorkerLoop_tick_func_t fn;
+	void *data;
+} wmWorkerLoop_tick;
+
+static wmWorkerLoop_tick *ticks = NULL;
+static int tick_head = 0; //下一个要执行的
+static int tick_num = 0;
+static int tick_size = 0;
+static int tick_depth = 0; //回调里面停掉loop的时候会嵌套执行
+
+#define has_ticks() (tick_num > tick_head)
+
+void wmWorkerLoop_nextTick(wmWorkerLoop_tick_func_t fn, void *data) {
+	if (tick_num == tick_size) {
+		int size = tick_size > 0 ? tick_size * 2 : 64;
+		wmWorkerLoop_tick *list = (wmWorkerLoop_tick*) wm_realloc(ticks, sizeof(wmWorkerLoop_tick) * size);
+		if (list == NULL) {
+			wmError("Error has occurred: (errno %d) %s", errno, strerror(errno));
+		}
+		ticks = list;
+		tick_size = size;
+	}
+	ticks[tick_num].fn = fn;
+	ticks[tick_num].data = data;
+	tick_num++;
+}
+
+//执行这一轮的nextTick
+static void run_ticks() {
+	int end = tick_num;
+	tick_depth++;
+	while (tick_head < end) {
+		//回调里面可能再加任务导致realloc，所以先拷贝出来
+		wmWorkerLoop_tick tick = ticks[tick_head++];
+		tick.fn(tick.data);
+	}
+	tick_depth--;
+	//嵌套的时候外面还在用下标，最外层再整理
+	if (tick_depth == 0) {
+		tick_num -= tick_head;
+		if (tick_num > 0) {
+			memmove(ticks, ticks + tick_head, sizeof(wmWorkerLoop_tick) * tick_num);
+		}
+		tick_head = 0;
 	}
+}
 
-	socket->events |= event;
+bool wmWorkerLoop_add(wmSocket *socket, int event) {
+	if (socket->events & event) { //如果socket里面有这个事件,那直接返回
+		return true;
+	}
 
 	//初始化epoll
 	loop_init();
-	struct epoll_event *ev;
-	ev = WorkerG.poll->event;
-	//转换epoll能看懂的事件类型
-	ev->events = event_decode(socket->events);
-	ev->data.ptr = socket;
-
-	//注册到全局的epollfd上面。
-	if (epoll_ctl(WorkerG.poll->epollfd, LOOP_TYPE, socket->fd, ev) < 0) {
-		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
-		return false;
+	//后端不支持边缘触发，就按全自动的方式来
+	if (socket->loop_type == WM_LOOP_EDGE && !WorkerG.poll->backend->edge_triggered) {
+		socket->loop_type = WM_LOOP_AUTO;
 	}
 
+	if (socket->loop_type == WM_LOOP_EDGE) {
+		//读写一次性注册上，之后不再修改，直到close
+		socket->events = WM_EVENT_READ | WM_EVENT_WRITE;
+	} else {
+		socket->events |= event;
+	}
+	pending_push(socket);
 	return true;
 }
 
@@ -140,31 +357,38 @@ bool wmWorkerLoop_remove(wmSocket *socket, int event) {
 	if (!(socket->events & event)) { //如果socket里面没有这个事件
 		return true;
 	}
-	socket->events &= (~event); //那么就减去这个事件
-	//如果已经没有事件了，就删除监听
-	if (socket->events == WM_EVENT_NULL) {
-		return wmWorkerLoop_del(socket);
-	}
-
-	struct epoll_event *ev;
-	ev = WorkerG.poll->event;
-	//转换epoll能看懂的事件类型
-	ev->events = event_decode(socket->events);
-	ev->data.ptr = socket;
-
-	//注册到全局的epollfd上面。
-	if (epoll_ctl(WorkerG.poll->epollfd, EPOLL_CTL_MOD, socket->fd, ev) < 0) {
-		wmWarn("Error has occurred: (errno %d) %s", errno, strerror(errno));
-		return false;
+	//边缘触发的注册一直保留，没事件的时候内核也不会通知
+	if (socket->loop_type == WM_LOOP_EDGE) {
+		return true;
 	}
+	socket->events &= (~event); //那么就减去这个事件
+	pending_push(socket);
 	return true;
 }
 
+/**
+ * 不再监听任何事件，同样是等到下一次epoll_wait之前才生效
+ */
 bool wmWorkerLoop_del(wmSocket *socket) {
 	if (socket->events != WM_EVENT_NULL) {
 		socket->events = WM_EVENT_NULL;
+		pending_push(socket);
+	}
+	return true;
+}
+
+/**
+ * socket要关闭或者释放了，马上从epoll里面删掉，也不能再留在pending_list里面
+ */
+bool wmWorkerLoop_detach(wmSocket *socket) {
+	pending_remove(socket);
+	socket->events = WM_EVENT_NULL;
+	if (socket->poll_events == WM_EVENT_NULL) {
+		return true;
 	}
-	if (epoll_ctl(WorkerG.poll->epollfd, EPOLL_CTL_DEL, socket->fd, NULL) < 0) {
+	socket->poll_events = WM_EVENT_NULL;
+	WorkerG.poll->event_num--;
+	if (wmPoll_ctl(EPOLL_CTL_DEL, socket->fd, NULL) < 0) {
 		wmWarn("Error has occurred: fd=%d (errno %d) %s", socket->fd, errno, strerror(errno));
 		return false;
 	}
@@ -172,29 +396,100 @@ bool wmWorkerLoop_del(wmSocket *socket) {
 }
 
 /**
- * 主事件循环，不同于wm_event_wait
+ * 开了忙轮询的时候，先用0超时空转一会儿，没有事件再阻塞等待
+ * 省掉睡眠和唤醒的时间，代价是CPU
  */
-void wmWorkerLoop_loop() {
+static int loop_wait(int timeout) {
+	if (WorkerG.busy_poll <= 0 || timeout == 0) {
+		return wmPoll_wait(timeout);
+	}
+	int n;
+	uint64_t begin = wmGetMonotonicMicroTime();
+	uint64_t now;
+	do {
+		n = wmPoll_wait(0);
+		now = wmGetMonotonicMicroTime();
+		//拿到事件或者出错了都不用再转了
+		if (n != 0) {
+			if (n > 0) {
+				loop_stats.spin_hits++;
+			}
+			wmHistogram_record(&loop_stats.spin, now - begin);
+			return n;
+		}
+	} while (now - begin < (uint64_t) WorkerG.busy_poll);
+	loop_stats.spin_misses++;
+	wmHistogram_record(&loop_stats.spin, now - begin);
+	//空转的时间要从超时里面扣掉
+	if (timeout > 0) {
+		timeout -= (int) ((now - begin) / 1000);
+		if (timeout <= 0) {
+			return 0;
+		}
+	}
+	return wmPoll_wait(timeout);
+}
+
+/**
+ * 事件循环，Worker和Coroutine::wait共用这一个
+ * until_idle为true的时候，没有定时器也没有协程在等待事件，就退出
+ */
+void wmWorkerLoop_run(bool until_idle) {
 	if (loop_init() < 0) {
 		wmError("Need to call init_wmPoll() first.");
 	}
 	WorkerG.is_running = true;
+	WorkerG.timer.lateness = &loop_stats.timer_lateness;
 
 	int n;
-	long mic_time;
+	uint64_t begin, end, cb_begin;
 	loop_callback_func_t fn;
+	//先把时间轮的时间对齐
+	wmTimerWheel_update(&WorkerG.timer, wm_update_now());
 	while (WorkerG.is_running) {
-		//毫秒级定时器，必须是1
-		int timeout = 1;
+		//上一轮攒下来的nextTick
+		if (has_ticks()) {
+			run_ticks();
+			//里面可能把loop停掉了
+			if (!WorkerG.poll) {
+				break;
+			}
+		}
+		//这一轮的监听变化一次提交
+		wmWorkerLoop_flush();
+		//没有定时器也没有协程在等了，再等下去就永远醒不过来了
+		if (until_idle && WorkerG.timer.num == 0 && WorkerG.poll->wait_num == 0 && !has_ticks() && !wmCoroutine_has_ready()) {
+			break;
+		}
+		//按最近的定时器算要睡多久，没有定时器就一直等事件
+		//handler里新加的定时器，下一轮进来的时候就算进去了
+		//还有nextTick没执行或者还有就绪的协程的话不能睡
+		int timeout = (has_ticks() || wmCoroutine_has_ready()) ? 0 : wmTimerWheel_next_timeout(&WorkerG.timer);
 		struct epoll_event *events;
+		begin = wmGetMonotonicMicroTime();
+		n = loop_wait(timeout);
+		end = wmGetMonotonicMicroTime();
+		//这一轮的回调里面拿到的都是这个时间
+		WorkerG.now = end;
+		wmHistogram_record(&loop_stats.wait, end - begin);
+		wmHistogram_record(&loop_stats.events, n > 0 ? n : 0);
+		begin = end;
 		events = WorkerG.poll->events;
-		n = epoll_wait(WorkerG.poll->epollfd, events, WorkerG.poll->ncap, timeout);
 		//循环处理epoll请求
 		for (int i = 0; i < n; i++) {
 			wmSocket *socket = events[i].data.ptr;
+			uint32_t revents = events[i].events;
 
+			if (socket->loop_type == WM_LOOP_EDGE) {
+				revents = edge_filter(socket, revents);
+			}
+			if (!(revents & (EPOLLIN | EPOLLOUT))) {
+				continue;
+			}
+
+			cb_begin = wmGetMonotonicMicroTime();
 			//read
-			if (events[i].events & EPOLLIN) {
+			if (revents & EPOLLIN) {
 				fn = wmWorkerLoop_get_handler(EPOLLIN, socket->loop_type);
 				if (fn != NULL) {
 					fn(socket, EPOLLIN);
@@ -202,23 +497,55 @@ void wmWorkerLoop_loop() {
 			}
 
 			//write 如果是可写，那么就恢复协程
-			if (events[i].events & EPOLLOUT) {
+			if (revents & EPOLLOUT) {
 				fn = wmWorkerLoop_get_handler(EPOLLOUT, socket->loop_type);
 				if (fn != NULL) {
 					fn(socket, EPOLLOUT);
 				}
 			}
+			wmHistogram_record(&loop_stats.callback, wmGetMonotonicMicroTime() - cb_begin);
 		}
-		//有定时器才更新
-		if (WorkerG.timer.num > 0) {
-			//获取毫秒
-			wmGetMilliTime(&mic_time);
-			wmTimerWheel_update(&WorkerG.timer, mic_time);
+		//事件处理完了才能调整事件数组，handler里面可能已经把loop停掉了
+		if (WorkerG.poll) {
+			wmPoll_adjust(n);
 		}
+		//没有定时器也要更新，让时间轮的时间跟上
+		//回调可能跑了很久，这里再读一次时钟
+		wmTimerWheel_update(&WorkerG.timer, wm_update_now());
+		//这一轮事件和定时器唤醒的协程，在下一次wait之前恢复
+		if (wmCoroutine_has_ready()) {
+			wmCoroutine_run_ready();
+		}
+		wmHistogram_record(&loop_stats.iteration, wmGetMonotonicMicroTime() - begin);
 	}
+	WorkerG.timer.lateness = NULL;
+}
+
+/**
+ * 获取loop的运行统计
+ */
+wmWorkerLoop_stats* wmWorkerLoop_get_stats() {
+	return &loop_stats;
+}
+
+/**
+ * Worker子进程的主事件循环，一直跑到进程退出
+ */
+void wmWorkerLoop_loop() {
+	wmWorkerLoop_run(false);
 	wmWorkerLoop_stop();
 }
 
 void wmWorkerLoop_stop() {
+	//还没来得及执行的nextTick，比如关闭连接时候的onClose，退出之前执行掉
+	while (has_ticks()) {
+		run_ticks();
+	}
+	for (int i = 0; i < pending_num; i++) {
+		if (pending_list[i]) {
+			pending_list[i]->pending = -1;
+		}
+	}
+	pending_num = 0;
 	free_wmPoll();
 }